@@ -9,8 +9,10 @@
 #include "TransformComponent.h"
 
 #include "GraphicsSystem.h"
+#include "Metrics.h"
 
 #include <GLFW/glfw3.h>
+#include <cstdio>
 
 namespace VEngine {
 	VulkanModelComponent* dragon;
@@ -28,8 +30,8 @@ namespace VEngine {
 		windowManager->Create(1920, 1080, "Game");
 		inputManager->init();
 
-		GraphicsSystem* gs = new GraphicsSystem();
-		systemManager->registerSystem(gs);
+		graphicsSystem = new GraphicsSystem();
+		systemManager->registerSystem(graphicsSystem);
 		
 		Scene* scene = new Scene();
 
@@ -64,8 +66,15 @@ namespace VEngine {
 		double lastTime = glfwGetTime();
 		int frameCount = 0;
 
+		Histogram* frameTime = Metrics::get().histogram("vengine_frame_time_ms", { 1.0, 2.0, 4.0, 7.0, 8.0, 12.0, 16.7, 33.3, 50.0, 100.0 }, "CPU time spent in a frame before the FPS limiter");
+		Counter* frames = Metrics::get().counter("vengine_frames_total", "Frames run by the main loop");
+		Gauge* gpuFrameTime = Metrics::get().gauge("vengine_gpu_last_frame_time_us", "GPU time of the last frame read back");
+
 		while (m_isRunning)
 		{
+			//Ahead of the input poll, so a low latency wait on the GPU isn't spent holding stale input
+			graphicsSystem->getRenderer()->beginFrame();
+
 			double currentTime = glfwGetTime();
 			frameCount++;
 
@@ -99,7 +108,9 @@ namespace VEngine {
 
 			systemManager->tick();
 
-			
+			frameTime->observe((glfwGetTime() - currentTime) * 1000.0);
+			frames->add();
+
 			//Limit FPS
 			while (glfwGetTime() < lastTime + 1.0 / 144) {
 				
@@ -109,10 +120,14 @@ namespace VEngine {
 			//Display FPS
 			if (currentTime - previousTime >= 1.0)
 			{
-				glfwSetWindowTitle(WindowManager::get().getHandle(), std::to_string(frameCount).c_str());
+				char title[64];
+				snprintf(title, sizeof(title), "%d fps, GPU %.2f ms", frameCount, gpuFrameTime->read() / 1000.0);
+				glfwSetWindowTitle(WindowManager::get().getHandle(), title);
 
 				frameCount = 0;
 				previousTime = currentTime;
+
+				Metrics::get().exportToFile("metrics.prom");
 			}
 
 		}
@@ -8,6 +8,8 @@
 #include "SystemManager.h"
 
 namespace VEngine {
+	class GraphicsSystem;
+
 	class Engine
 	{
 	public:
@@ -22,6 +24,7 @@ namespace VEngine {
 		InputManager* inputManager;
 		SceneManager* sceneManager;
 		WindowManager* windowManager;
+		GraphicsSystem* graphicsSystem;
 
 	};
 }
@@ -0,0 +1,107 @@
+#include "CullingBenchmark.h"
+#include "FrustumCulling.h"
+#include "WorkerPool.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace VEngine {
+
+	static double timePass(const std::string& name, uint32_t iterations, size_t total, size_t& visible, const std::function<size_t()>& pass)
+	{
+		double best = 0.0;
+
+		//One untimed pass to fault the output in and warm the caches
+		visible = pass();
+
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			visible = pass();
+			auto end = std::chrono::high_resolution_clock::now();
+
+			double ms = std::chrono::duration<double, std::milli>(end - start).count();
+			if (i == 0 || ms < best)
+				best = ms;
+		}
+
+		std::cout << name << ": " << best << " ms, " << (total / best / 1000.0) << " M boxes/s, " << visible << " visible" << std::endl;
+		return best;
+	}
+
+	static bool matchesScalar(const std::string& name, const std::vector<uint8_t>& scalar, const std::vector<uint8_t>& visible, size_t scalarCount, size_t count)
+	{
+		if (memcmp(scalar.data(), visible.data(), scalar.size()) == 0 && count == scalarCount)
+			return true;
+
+		auto differs = std::mismatch(scalar.begin(), scalar.end(), visible.begin());
+		if (differs.first == scalar.end())
+			std::cout << name << " disagrees with scalar on the visible count, " << count << " against " << scalarCount << "!" << std::endl;
+		else
+			std::cout << name << " disagrees with scalar first at box " << (differs.first - scalar.begin()) << "!" << std::endl;
+
+		return false;
+	}
+
+	int runCullingBenchmark(size_t count, uint32_t iterations)
+	{
+		std::cout << "Culling " << count << " boxes, best of " << iterations << " passes" << std::endl;
+
+		//Boxes scattered around the camera so roughly a fifth of them land in the frustum
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> extent(0.5f, 4.0f);
+
+		CullSpheres spheres;
+		spheres.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::vec3 center(position(random), position(random), position(random));
+			glm::vec3 halfSize(extent(random), extent(random), extent(random));
+			spheres.push_back(center, glm::length(halfSize));
+		}
+
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 proj = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+		Frustum frustum = Frustum::fromMatrix(proj * view);
+
+		//Each variant writes its own output so they can be checked against the scalar one
+		std::vector<uint8_t> scalarVisible(count), sseVisible(count), avxVisible(count), parallelVisible(count);
+		size_t scalarCount = 0, sseCount = 0, avxCount = 0, parallelCount = 0;
+
+		WorkerPool pool;
+		pool.start(std::max(1u, std::thread::hardware_concurrency()) - 1);
+
+		double scalar = timePass("scalar", iterations, count, scalarCount, [&]() { return cullSpheres(frustum, spheres, scalarVisible.data(), CullMethod::Scalar); });
+		double sse = timePass("sse", iterations, count, sseCount, [&]() { return cullSpheres(frustum, spheres, sseVisible.data(), CullMethod::SSE); });
+
+		double avx = 0.0;
+		if (cpuSupportsAVX())
+			avx = timePass("avx", iterations, count, avxCount, [&]() { return cullSpheres(frustum, spheres, avxVisible.data(), CullMethod::AVX); });
+		else
+			std::cout << "avx: not supported by this CPU" << std::endl;
+
+		double parallel = timePass("best x " + std::to_string(pool.getThreadCount()) + " threads", iterations, count, parallelCount, [&]() { return cullSpheresParallel(frustum, spheres, parallelVisible.data(), pool); });
+
+		std::cout << "speedup over scalar: sse " << scalar / sse;
+		if (avx > 0.0)
+			std::cout << ", avx " << scalar / avx;
+		std::cout << ", threaded " << scalar / parallel << std::endl;
+
+		//Every variant does the same arithmetic in the same order, so the results should agree exactly
+		bool agree = matchesScalar("sse", scalarVisible, sseVisible, scalarCount, sseCount);
+		if (avx > 0.0)
+			agree = matchesScalar("avx", scalarVisible, avxVisible, scalarCount, avxCount) && agree;
+		agree = matchesScalar("threaded", scalarVisible, parallelVisible, scalarCount, parallelCount) && agree;
+
+		return agree ? 0 : 1;
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace VEngine {
+
+	/*
+	 * Frustum culls a field of random boxes with each CPU variant, scalar, SSE, AVX and split across threads, and prints
+	 * the time per pass and how many boxes each kept. Run with --bench-culling [count], no window or device is created.
+	 */
+	int runCullingBenchmark(size_t count = 1000000, uint32_t iterations = 20);
+}
@@ -2,6 +2,7 @@
 #include <unordered_map>
 #include <algorithm>
 #include "Manager.h"
+#include "Metrics.h"
 #include "Entity.h"
 namespace VEngine {
 	class BaseEventSubscriber
@@ -105,6 +106,9 @@ namespace VEngine {
 		template<typename T>
 		inline void emit(const T& event)
 		{
+			static Counter* emitted = Metrics::get().counter("vengine_events_emitted_total", "Events emitted, by event type", std::string("type=\"") + typeid(T).name() + "\"");
+			emitted->add();
+
 			auto found = m_subscribers.find(std::type_index(typeid(T)));
 			if (found != m_subscribers.end())
 			{
@@ -0,0 +1,223 @@
+#include "FrustumCulling.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VENGINE_CULL_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//MSVC compiles AVX intrinsics anywhere, GCC and Clang need the function marked for them
+#if defined(__GNUC__) || defined(__clang__)
+#define VENGINE_TARGET_AVX __attribute__((target("avx")))
+#else
+#define VENGINE_TARGET_AVX
+#endif
+
+namespace VEngine {
+
+	Frustum Frustum::fromMatrix(const glm::mat4& m)
+	{
+		//Gribb/Hartmann, rows of the matrix combined, with the 0..1 depth range
+		glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		Frustum frustum;
+		frustum.planes[0] = row3 + row0;
+		frustum.planes[1] = row3 - row0;
+		frustum.planes[2] = row3 + row1;
+		frustum.planes[3] = row3 - row1;
+		frustum.planes[4] = row2;
+		frustum.planes[5] = row3 - row2;
+
+		for (glm::vec4& plane : frustum.planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+
+		return frustum;
+	}
+
+	bool cpuSupportsAVX()
+	{
+		static const bool supported = []() {
+#if defined(VENGINE_CULL_SIMD) && defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+
+			//The CPU has to have AVX and the OS has to save the YMM registers across context switches
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx)
+				return false;
+
+			return (_xgetbv(0) & 0x6) == 0x6;
+#elif defined(VENGINE_CULL_SIMD)
+			return __builtin_cpu_supports("avx") != 0;
+#else
+			return false;
+#endif
+		}();
+
+		return supported;
+	}
+
+	static size_t cullScalar(const Frustum& frustum, const CullSpheres& spheres, size_t begin, size_t end, uint8_t* visible)
+	{
+		size_t count = 0;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			bool inside = true;
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w;
+				inside = inside && distance >= -spheres.radius[i];
+			}
+
+			visible[i] = inside ? 1 : 0;
+			count += visible[i];
+		}
+
+		return count;
+	}
+
+#ifdef VENGINE_CULL_SIMD
+	static size_t cullSSE(const Frustum& frustum, const CullSpheres& spheres, size_t begin, size_t end, uint8_t* visible)
+	{
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		size_t count = 0;
+		size_t i = begin;
+
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&spheres.x[i]);
+			__m128 y = _mm_loadu_ps(&spheres.y[i]);
+			__m128 z = _mm_loadu_ps(&spheres.z[i]);
+			__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&spheres.radius[i]));
+
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_mul_ps(planeZ[p], z)), planeW[p]);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				visible[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+				count += visible[i + lane];
+			}
+		}
+
+		return count + cullScalar(frustum, spheres, i, end, visible);
+	}
+
+	VENGINE_TARGET_AVX static size_t cullAVX(const Frustum& frustum, const CullSpheres& spheres, size_t begin, size_t end, uint8_t* visible)
+	{
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 allSet = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+		size_t count = 0;
+		size_t i = begin;
+
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+			__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+			__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+			__m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&spheres.radius[i]));
+
+			__m256 inside = allSet;
+			for (int p = 0; p < 6; p++)
+			{
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)), _mm256_mul_ps(planeZ[p], z)), planeW[p]);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+			}
+
+			int mask = _mm256_movemask_ps(inside);
+			for (int lane = 0; lane < 8; lane++)
+			{
+				visible[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+				count += visible[i + lane];
+			}
+		}
+
+		//Leave the AVX state clean before the SSE tail and whatever the caller runs next
+		_mm256_zeroupper();
+
+		return count + cullSSE(frustum, spheres, i, end, visible);
+	}
+#endif
+
+	size_t cullSpheres(const Frustum& frustum, const CullSpheres& spheres, uint8_t* visible, CullMethod method)
+	{
+		return cullSpheres(frustum, spheres, 0, spheres.size(), visible, method);
+	}
+
+	size_t cullSpheres(const Frustum& frustum, const CullSpheres& spheres, size_t begin, size_t end, uint8_t* visible, CullMethod method)
+	{
+#ifdef VENGINE_CULL_SIMD
+		if (method == CullMethod::Best)
+			method = cpuSupportsAVX() ? CullMethod::AVX : CullMethod::SSE;
+
+		if (method == CullMethod::AVX && cpuSupportsAVX())
+			return cullAVX(frustum, spheres, begin, end, visible);
+
+		if (method == CullMethod::SSE || method == CullMethod::AVX)
+			return cullSSE(frustum, spheres, begin, end, visible);
+#endif
+
+		return cullScalar(frustum, spheres, begin, end, visible);
+	}
+
+	size_t cullSpheresParallel(const Frustum& frustum, const CullSpheres& spheres, uint8_t* visible, WorkerPool& pool, CullMethod method)
+	{
+		size_t total = spheres.size();
+		uint32_t threadCount = pool.getThreadCount();
+		if (threadCount <= 1 || total < threadCount * 8)
+			return cullSpheres(frustum, spheres, 0, total, visible, method);
+
+		//Chunks stay a multiple of eight so only the last one has a scalar tail
+		size_t chunk = ((total + threadCount - 1) / threadCount + 7) / 8 * 8;
+		std::vector<size_t> counts(threadCount, 0);
+
+		pool.run(threadCount, [&](uint32_t t) {
+			size_t begin = std::min(total, t * chunk);
+			size_t end = std::min(total, begin + chunk);
+			counts[t] = cullSpheres(frustum, spheres, begin, end, visible, method);
+		});
+
+		size_t count = 0;
+		for (size_t c : counts)
+		{
+			count += c;
+		}
+
+		return count;
+	}
+}
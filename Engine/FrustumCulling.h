@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace VEngine {
+
+	class WorkerPool;
+
+	//Below this many spheres waking the pool's workers costs more than splitting the work saves
+	const static size_t CULL_PARALLEL_THRESHOLD = 65536;
+
+	enum class CullMethod
+	{
+		Scalar,
+		SSE,
+		AVX,
+		//AVX when the CPU has it, SSE otherwise
+		Best
+	};
+
+	//Planes facing into the frustum, xyz the normal and w the distance
+	struct Frustum {
+		glm::vec4 planes[6];
+
+		//Planes of a view projection with a zero to one depth range, in whatever space the matrix maps from
+		static Frustum fromMatrix(const glm::mat4& viewProj);
+	};
+
+	/*
+	 * Bounding spheres kept as one array per component, so four or eight of them load straight into an SSE or AVX
+	 * register and get tested against each plane at once.
+	 */
+	struct CullSpheres {
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> radius;
+
+		void clear() { x.clear(); y.clear(); z.clear(); radius.clear(); };
+		void reserve(size_t count) { x.reserve(count); y.reserve(count); z.reserve(count); radius.reserve(count); };
+		size_t size() const { return x.size(); };
+
+		void push_back(const glm::vec3& center, float r) {
+			x.push_back(center.x);
+			y.push_back(center.y);
+			z.push_back(center.z);
+			radius.push_back(r);
+		};
+	};
+
+	bool cpuSupportsAVX();
+
+	//Writes 1 into visible for every sphere at least partly inside the frustum and 0 for the rest, returns how many are visible
+	size_t cullSpheres(const Frustum& frustum, const CullSpheres& spheres, uint8_t* visible, CullMethod method = CullMethod::Best);
+	size_t cullSpheres(const Frustum& frustum, const CullSpheres& spheres, size_t begin, size_t end, uint8_t* visible, CullMethod method = CullMethod::Best);
+
+	//Same as cullSpheres, with the spheres split evenly between the pool's threads
+	size_t cullSpheresParallel(const Frustum& frustum, const CullSpheres& spheres, uint8_t* visible, WorkerPool& pool, CullMethod method = CullMethod::Best);
+}
@@ -21,7 +21,7 @@ namespace VEngine {
 
 		~GraphicsComponent() {};
 
-		VulkanModelComponent* model;
+		VulkanModelComponent* model = nullptr;
 
 		std::string filename;
 
@@ -7,6 +7,7 @@
 
 #include "GraphicsComponent.h"
 #include "TransformComponent.h"
+#include "Metrics.h"
 
 namespace VEngine {
 
@@ -18,7 +19,13 @@ namespace VEngine {
 		eventManager->subscribe<Events::OnEntityCreated>(this);
 
 		m_renderer = new VulkanRenderer();
-		m_renderer->initVulkan((int)WindowManager::get().getSize().x, (int)WindowManager::get().getSize().y);
+		if (m_headless)
+		{
+			m_renderer->headless = true;
+			m_renderer->initVulkan(m_width, m_height);
+		}
+		else
+			m_renderer->initVulkan((int)WindowManager::get().getSize().x, (int)WindowManager::get().getSize().y);
 	}
 
 	void GraphicsSystem::shutdown()
@@ -43,29 +50,40 @@ namespace VEngine {
 
 			ModelCreateInfo modelCreateInfo;
 
-			if (ent->has<TransformComponent>())
-			{
-				ComponentHandle<TransformComponent> tc = ent->get<TransformComponent>();
-				modelCreateInfo = ModelCreateInfo(glm::vec3(1.0f), glm::vec3(1.0f), tc->getPosition());
-			}
-			else
-			{
-				modelCreateInfo = ModelCreateInfo(glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-			}
+			//Positions come from the object buffer each frame rather than being baked into the vertices
+			modelCreateInfo = ModelCreateInfo(glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 
 			
 			
 			if (gc->filename.size() != 0)
 			{
 				gc->model = new VulkanModelComponent();
-				gc->model->model = new Model();
-				gc->model->model->loadFromFile(gc->filename, vertexLayout, modelCreateInfo, m_renderer->getDevice(), m_renderer->getDevice()->getGraphicsQueue());
+
+				//Entities loading the same file share one mesh, which lets the renderer instance them
+				auto cached = m_meshes.find(gc->filename);
+				if (cached != m_meshes.end())
+				{
+					gc->model->model = cached->second;
+				}
+				else
+				{
+					gc->model->model = new Model();
+					gc->model->model->loadFromFile(gc->filename, vertexLayout, modelCreateInfo, m_renderer->getDevice());
+					m_meshes[gc->filename] = gc->model->model;
+				}
+
+				//Meshes from files are closed, so their back faces are skipped, double sided until that pipeline has compiled
+				PipelineDesc desc = m_renderer->getDefaultPipelineDesc();
+				desc.cullMode = VK_CULL_MODE_BACK_BIT;
+				gc->model->pipeline = m_renderer->requestPipeline(desc);
 			}
 			else
 			{
 				gc->model->model->device = m_renderer->getDevice()->getDevice();
 			}
 
+			m_meshReferences[gc->model->model]++;
+
 			m_renderer->pushBackModel(ent->getId(), gc->model);
 
 			
@@ -82,11 +100,27 @@ namespace VEngine {
 		if (ent->has<GraphicsComponent>())
 		{
 			ComponentHandle<GraphicsComponent> gc = ent->get<GraphicsComponent>();
-			
-			vkDeviceWaitIdle(m_renderer->getDevice()->getDevice());
-			gc->model->model->destroy();
-			delete gc->model;
+			Model* model = gc->model->model;
+
 			m_renderer->removeModel(ent->getId());
+			delete gc->model;
+			gc->model = nullptr;
+
+			//The mesh stays alive until the last entity using it goes
+			if (--m_meshReferences[model] == 0)
+			{
+				m_meshReferences.erase(model);
+				for (auto it = m_meshes.begin(); it != m_meshes.end(); ++it)
+				{
+					if (it->second == model)
+					{
+						m_meshes.erase(it);
+						break;
+					}
+				}
+
+				m_renderer->retireModel(model);
+			}
 		}
 
 		
@@ -99,18 +133,57 @@ namespace VEngine {
 
 	void GraphicsSystem::tick() {
 
+		m_renderer->updateCamera();
+
+		//Without GPU culling every instance would be drawn, so the frustum test happens here instead
+		bool cpuCulling = !m_renderer->isGpuCulling();
+		m_cullSpheres.clear();
+		m_cullModels.clear();
+
 		for (Entity* ent : SceneManager::get().each<GraphicsComponent>())
 		{
 			ComponentHandle<GraphicsComponent> gc = ent->get<GraphicsComponent>();
+			if (!gc->model)
+				continue;
 			
+			if (ent->has<TransformComponent>())
+			{
+				ComponentHandle<TransformComponent> tc = ent->get<TransformComponent>();
+				gc->model->transform = glm::translate(tc->getPosition());
+			}
 
-		}
+			if (cpuCulling)
+			{
+				const glm::mat4& transform = gc->model->transform;
+				const Model* model = gc->model->model;
 
+				//Sphere around the mesh bounds, grown by the largest scale in the transform
+				glm::vec3 center = glm::vec3(transform * glm::vec4((model->dim.min + model->dim.max) * 0.5f, 1.0f));
+				float scale = glm::max(glm::max(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1]))), glm::length(glm::vec3(transform[2])));
 
-		if (m_renderer->sceneChanged)
+				m_cullSpheres.push_back(center, glm::length(model->dim.size) * 0.5f * scale);
+				m_cullModels.push_back(gc->model);
+			}
+		}
+
+		if (cpuCulling && !m_cullModels.empty())
 		{
-			m_renderer->updateCommandBuffers();
-			m_renderer->sceneChanged = false;
+			m_cullVisible.resize(m_cullModels.size());
+
+			Frustum frustum = Frustum::fromMatrix(m_renderer->getViewProjection());
+			size_t visible;
+			if (m_cullSpheres.size() >= CULL_PARALLEL_THRESHOLD)
+				visible = cullSpheresParallel(frustum, m_cullSpheres, m_cullVisible.data(), *m_renderer->getWorkerPool());
+			else
+				visible = cullSpheres(frustum, m_cullSpheres, m_cullVisible.data());
+
+			for (size_t i = 0; i < m_cullModels.size(); i++)
+			{
+				m_cullModels[i]->visible = m_cullVisible[i] != 0;
+			}
+
+			static Gauge* culled = Metrics::get().gauge("vengine_cpu_culled_objects", "Objects left out of the last frame by the CPU frustum test");
+			culled->set(static_cast<int64_t>(m_cullModels.size() - visible));
 		}
 
 		m_renderer->drawFrame();
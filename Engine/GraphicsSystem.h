@@ -8,6 +8,7 @@
 
 #include "GraphicsComponent.h"
 #include "VulkanRenderer.h"
+#include "FrustumCulling.h"
 
 namespace VEngine {
 
@@ -18,6 +19,9 @@ namespace VEngine {
 		public EventSubscriber<Events::OnComponentRemoved<GraphicsComponent>>
 	{
 	public:
+		GraphicsSystem() {}
+		//Renders offscreen at this size rather than into the window, see VulkanRenderer::headless
+		GraphicsSystem(int width, int height) : m_headless(true), m_width(width), m_height(height) {}
 		virtual ~GraphicsSystem() {}
 
 		virtual void init();
@@ -26,6 +30,10 @@ namespace VEngine {
 
 		virtual void tick();
 
+		virtual const char* getName() const { return "graphics"; }
+
+		VulkanRenderer* getRenderer() { return m_renderer; };
+
 		virtual void receive(const Events::OnEntityInit& event);
 
 		virtual void receive(const Events::OnEntityCreated& event);
@@ -35,6 +43,19 @@ namespace VEngine {
 		virtual void receive(const Events::OnComponentRemoved<GraphicsComponent>& event);
 	private:
 		VulkanRenderer* m_renderer;
+
+		bool m_headless = false;
+		int m_width = 0;
+		int m_height = 0;
+
+		//Meshes loaded from file, and how many entities use each mesh
+		std::map<std::string, Model*> m_meshes;
+		std::map<Model*, uint32_t> m_meshReferences;
+
+		//Bounding spheres of every model this frame, and which of them the CPU frustum test kept
+		CullSpheres m_cullSpheres;
+		std::vector<VulkanModelComponent*> m_cullModels;
+		std::vector<uint8_t> m_cullVisible;
 	};
 
 }
@@ -0,0 +1,76 @@
+#include "HeadlessRender.h"
+#include "VulkanRenderer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <vector>
+
+namespace VEngine {
+
+	int runHeadlessRender(uint32_t frames, const std::string& output, int width, int height)
+	{
+		VulkanRenderer renderer;
+		renderer.headless = true;
+		renderer.readback = !output.empty();
+
+		try
+		{
+			renderer.initVulkan(width, height);
+
+			Model* cube = new Model();
+			ModelCreateInfo modelCreateInfo(glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+			cube->loadFromFile("resources/models/cube.obj", vertexLayout, modelCreateInfo, renderer.getDevice());
+
+			//Fixed placements, and the camera is only set up once in initVulkan, so every run draws the same frame
+			std::vector<VulkanModelComponent*> models;
+			for (int x = -4; x <= 4; x++)
+			{
+				for (int z = -4; z <= 4; z++)
+				{
+					VulkanModelComponent* model = new VulkanModelComponent();
+					model->model = cube;
+					model->transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * 3.0f, 0.0f, z * 3.0f));
+					renderer.pushBackModel(static_cast<int>(models.size()), model);
+					models.push_back(model);
+				}
+			}
+
+			//Models are skipped until their upload lands, which shouldn't depend on how fast the copy queue is
+			renderer.getDevice()->flushUploads();
+
+			for (uint32_t i = 0; i < frames; i++)
+			{
+				renderer.drawFrame();
+			}
+
+			int result = 0;
+			if (!output.empty())
+			{
+				if (renderer.saveFrame(output))
+					std::cout << "Wrote " << output << std::endl;
+				else
+				{
+					std::cout << "Failed to write " << output << std::endl;
+					result = 1;
+				}
+			}
+
+			vkDeviceWaitIdle(renderer.getDevice()->getDevice());
+			for (VulkanModelComponent* model : models)
+			{
+				delete model;
+			}
+			cube->destroy();
+			delete cube;
+
+			renderer.cleanup();
+			return result;
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+	}
+}
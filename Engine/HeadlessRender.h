@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace VEngine {
+
+	/*
+	 * Renders a grid of cubes offscreen for a number of frames, with no window or surface, and writes the last frame to
+	 * output as a PNG when one is given. Runs on software drivers without presentation, for CI and golden images.
+	 * Run with --headless [frames] [output.png].
+	 */
+	int runHeadlessRender(uint32_t frames = 3, const std::string& output = "", int width = 1280, int height = 720);
+}
@@ -24,6 +24,8 @@ namespace VEngine {
 	static double mouseX = 0;
 	static double mouseY = 0;
 
+	static std::chrono::steady_clock::time_point pollTime;
+
 
 	void InputManager::clean()
 	{
@@ -145,10 +147,16 @@ namespace VEngine {
 		glfwSetCursorPosCallback(WindowManager::get().getHandle(), getMouseMoved);
 		glfwSetMouseButtonCallback(WindowManager::get().getHandle(), getMouseInput);
 	}
+	std::chrono::steady_clock::time_point InputManager::getPollTime()
+	{
+		return pollTime;
+	}
+
 	void InputManager::update()
 	{
 		clean();
 		glfwPollEvents();
+		pollTime = std::chrono::steady_clock::now();
 		
 
 		//sf::Event event;
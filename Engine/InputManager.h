@@ -7,6 +7,7 @@
 #include "Manager.h"
 #include "WindowManager.h"
 #include <GLFW/glfw3.h>
+#include <chrono>
 namespace VEngine {
 
 
@@ -36,6 +37,9 @@ namespace VEngine {
 
 		static void update();
 
+		//When events were last polled, the start of the input to present latency the renderer measures
+		static std::chrono::steady_clock::time_point getPollTime();
+
 		static void clean();
 
 
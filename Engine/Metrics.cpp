@@ -0,0 +1,195 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace VEngine {
+
+	namespace MetricsDetail
+	{
+		static std::atomic<size_t> nextShard{ 0 };
+
+		size_t threadShard()
+		{
+			static thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+			return shard;
+		}
+	}
+
+	Histogram::Histogram(std::vector<double> bounds)
+		: m_bounds(std::move(bounds))
+	{
+		std::sort(m_bounds.begin(), m_bounds.end());
+		m_buckets.reset(new Counter[m_bounds.size() + 1]);
+	}
+
+	void Histogram::observe(double value)
+	{
+		//Buckets are inclusive upper bounds, so the first bound >= value owns the observation
+		size_t bucket = std::lower_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin();
+
+		m_buckets[bucket].add();
+		m_count.add();
+		m_sumMilli.add(static_cast<int64_t>(value * 1000.0));
+	}
+
+	std::vector<int64_t> Histogram::readBuckets() const
+	{
+		std::vector<int64_t> buckets(m_bounds.size() + 1);
+		int64_t total = 0;
+		for (size_t i = 0; i < buckets.size(); i++)
+		{
+			total += m_buckets[i].read();
+			buckets[i] = total;
+		}
+		return buckets;
+	}
+
+	double Histogram::readSum() const
+	{
+		return static_cast<double>(m_sumMilli.read()) / 1000.0;
+	}
+
+	Metrics::Family& Metrics::getFamily(const std::string& name, MetricType type, const std::string& help)
+	{
+		auto found = m_families.find(name);
+		if (found == m_families.end())
+		{
+			Family family;
+			family.type = type;
+			family.help = help;
+			found = m_families.insert({ name, std::move(family) }).first;
+		}
+		else if (found->second.type != type)
+		{
+			ELOG("Metric ", name, " was registered with a different type!");
+			throw std::runtime_error("Metric registered with a different type!");
+		}
+		else if (found->second.help.empty())
+		{
+			found->second.help = help;
+		}
+
+		return found->second;
+	}
+
+	Counter* Metrics::counter(const std::string& name, const std::string& help, const std::string& labels)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Family& family = getFamily(name, MetricType::Counter, help);
+
+		auto& metric = family.counters[labels];
+		if (!metric)
+			metric.reset(new Counter());
+
+		return metric.get();
+	}
+
+	Gauge* Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Family& family = getFamily(name, MetricType::Gauge, help);
+
+		auto& metric = family.gauges[labels];
+		if (!metric)
+			metric.reset(new Gauge());
+
+		return metric.get();
+	}
+
+	Histogram* Metrics::histogram(const std::string& name, std::vector<double> bounds, const std::string& help, const std::string& labels)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Family& family = getFamily(name, MetricType::Histogram, help);
+
+		auto& metric = family.histograms[labels];
+		if (!metric)
+			metric.reset(new Histogram(std::move(bounds)));
+
+		return metric.get();
+	}
+
+	static std::string seriesName(const std::string& name, const std::string& labels, const std::string& extraLabel = "")
+	{
+		if (labels.empty() && extraLabel.empty())
+			return name;
+
+		std::string series = name + "{" + labels;
+		if (!labels.empty() && !extraLabel.empty())
+			series += ",";
+		series += extraLabel + "}";
+		return series;
+	}
+
+	void Metrics::writeSnapshot(std::ostream& out)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (auto& kv : m_families)
+		{
+			const std::string& name = kv.first;
+			Family& family = kv.second;
+
+			if (!family.help.empty())
+				out << "# HELP " << name << " " << family.help << "\n";
+
+			switch (family.type)
+			{
+			case MetricType::Counter:
+				out << "# TYPE " << name << " counter\n";
+				for (auto& series : family.counters)
+					out << seriesName(name, series.first) << " " << series.second->read() << "\n";
+				break;
+			case MetricType::Gauge:
+				out << "# TYPE " << name << " gauge\n";
+				for (auto& series : family.gauges)
+					out << seriesName(name, series.first) << " " << series.second->read() << "\n";
+				break;
+			case MetricType::Histogram:
+				out << "# TYPE " << name << " histogram\n";
+				for (auto& series : family.histograms)
+				{
+					Histogram* histogram = series.second.get();
+					std::vector<int64_t> buckets = histogram->readBuckets();
+					for (size_t i = 0; i < histogram->getBounds().size(); i++)
+					{
+						std::ostringstream le;
+						le << "le=\"" << histogram->getBounds()[i] << "\"";
+						out << seriesName(name + "_bucket", series.first, le.str()) << " " << buckets[i] << "\n";
+					}
+					out << seriesName(name + "_bucket", series.first, "le=\"+Inf\"") << " " << buckets.back() << "\n";
+					out << seriesName(name + "_sum", series.first) << " " << histogram->readSum() << "\n";
+					out << seriesName(name + "_count", series.first) << " " << histogram->readCount() << "\n";
+				}
+				break;
+			}
+		}
+	}
+
+	bool Metrics::exportToFile(const std::string& path)
+	{
+		std::string tempPath = path + ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::out | std::ios::trunc);
+			if (!file.is_open())
+			{
+				WLOG("Failed to open metrics file!");
+				return false;
+			}
+
+			writeSnapshot(file);
+		}
+
+		std::remove(path.c_str());
+		if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+		{
+			WLOG("Failed to write metrics file!");
+			return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "Manager.h"
+
+namespace VEngine {
+
+	//Number of independent slots a counter is split over. Each thread writes to its own slot so
+	//hot counters never bounce a single cache line between cores, the slots are summed on read.
+	const static size_t METRIC_SHARDS = 16;
+
+	namespace MetricsDetail
+	{
+		struct alignas(64) Shard
+		{
+			std::atomic<int64_t> value{ 0 };
+		};
+
+		size_t threadShard();
+	}
+
+	class Counter
+	{
+	public:
+		void add(int64_t amount = 1)
+		{
+			m_shards[MetricsDetail::threadShard()].value.fetch_add(amount, std::memory_order_relaxed);
+		}
+
+		int64_t read() const
+		{
+			int64_t total = 0;
+			for (auto& shard : m_shards)
+			{
+				total += shard.value.load(std::memory_order_relaxed);
+			}
+			return total;
+		}
+
+	private:
+		MetricsDetail::Shard m_shards[METRIC_SHARDS];
+	};
+
+	class Gauge
+	{
+	public:
+		void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+		void add(int64_t amount = 1) { m_value.fetch_add(amount, std::memory_order_relaxed); }
+		void sub(int64_t amount = 1) { m_value.fetch_sub(amount, std::memory_order_relaxed); }
+
+		int64_t read() const { return m_value.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<int64_t> m_value{ 0 };
+	};
+
+	class Histogram
+	{
+	public:
+		Histogram(std::vector<double> bounds);
+
+		void observe(double value);
+
+		const std::vector<double>& getBounds() const { return m_bounds; };
+
+		//Cumulative count per bound, the last entry is the +Inf bucket
+		std::vector<int64_t> readBuckets() const;
+		double readSum() const;
+		int64_t readCount() const { return m_count.read(); };
+
+	private:
+		std::vector<double> m_bounds;
+		std::unique_ptr<Counter[]> m_buckets;
+		Counter m_count;
+
+		//Sum is kept in fixed point (1/1000th units) so it can live in a sharded integer counter
+		Counter m_sumMilli;
+	};
+
+	class Metrics : public Manager<Metrics>
+	{
+	public:
+		Metrics(void) {};
+		~Metrics(void) {};
+
+		//Returned pointers stay valid for the lifetime of the registry, callers should cache them
+		//(usually in a function local static) rather than look them up on every update.
+		Counter* counter(const std::string& name, const std::string& help = "", const std::string& labels = "");
+		Gauge* gauge(const std::string& name, const std::string& help = "", const std::string& labels = "");
+		Histogram* histogram(const std::string& name, std::vector<double> bounds, const std::string& help = "", const std::string& labels = "");
+
+		//Writes every metric in the Prometheus text exposition format
+		void writeSnapshot(std::ostream& out);
+
+		//Writes a snapshot to a temporary file then renames it over path, so a scraper polling the file never sees a partial write
+		bool exportToFile(const std::string& path);
+
+	private:
+		enum class MetricType
+		{
+			Counter,
+			Gauge,
+			Histogram
+		};
+
+		struct Family
+		{
+			MetricType type;
+			std::string help;
+			std::map<std::string, std::unique_ptr<Counter>> counters;
+			std::map<std::string, std::unique_ptr<Gauge>> gauges;
+			std::map<std::string, std::unique_ptr<Histogram>> histograms;
+		};
+
+		Family& getFamily(const std::string& name, MetricType type, const std::string& help);
+
+		std::map<std::string, Family> m_families;
+		std::mutex m_mutex;
+	};
+}
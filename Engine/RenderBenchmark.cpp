@@ -0,0 +1,247 @@
+#include "RenderBenchmark.h"
+
+#include "Entity.h"
+#include "Scene.h"
+#include "SceneManager.h"
+#include "SystemManager.h"
+#include "GraphicsComponent.h"
+#include "TransformComponent.h"
+#include "GraphicsSystem.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace VEngine {
+
+	struct RenderScenario
+	{
+		const char* name;
+		const char* model;
+		uint32_t count;
+		//Instances despawned and spawned again each frame
+		uint32_t churn;
+		float spacing;
+	};
+
+	static const RenderScenario SCENARIOS[] = {
+		{ "small", "resources/models/cube.obj", 10000, 0, 3.0f },
+		{ "large", "resources/models/dragon2.obj", 16, 0, 20.0f },
+		{ "churn", "resources/models/cube.obj", 2000, 200, 3.0f },
+	};
+
+	//Frames left out of the report while pipelines and uploads settle
+	static const uint32_t WARMUP_FRAMES = 10;
+
+	static const int BENCHMARK_WIDTH = 1280;
+	static const int BENCHMARK_HEIGHT = 720;
+
+	static void writeStats(std::ostream& out, std::vector<double> samples)
+	{
+		if (samples.empty())
+		{
+			out << "null";
+			return;
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		double sum = 0.0;
+		for (double sample : samples)
+		{
+			sum += sample;
+		}
+
+		auto percentile = [&](double p) { return samples[static_cast<size_t>(p * (samples.size() - 1))]; };
+
+		out << "{ \"mean\": " << sum / samples.size()
+			<< ", \"min\": " << samples.front()
+			<< ", \"p50\": " << percentile(0.5)
+			<< ", \"p95\": " << percentile(0.95)
+			<< ", \"max\": " << samples.back() << " }";
+	}
+
+	class BenchmarkScene
+	{
+	public:
+		BenchmarkScene(Scene* scene, const RenderScenario& scenario) : m_scene(scene), m_scenario(scenario)
+		{
+			m_side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(scenario.count))));
+		}
+
+		void spawn(uint32_t slot)
+		{
+			float offset = (m_side - 1) * m_scenario.spacing * 0.5f;
+			glm::vec3 position((slot % m_side) * m_scenario.spacing - offset, 0.0f, (slot / m_side) * m_scenario.spacing - offset);
+
+			Entity* e = m_scene->createEntity();
+			e->addComponent<TransformComponent>(position);
+			e->addComponent<GraphicsComponent>(m_scenario.model);
+			m_scene->init(e);
+
+			m_live.push_back({ e, slot });
+		}
+
+		//The oldest instances go and come back in the same slots, so the scene looks the same every frame
+		void churn()
+		{
+			for (uint32_t i = 0; i < m_scenario.churn && !m_live.empty(); i++)
+			{
+				std::pair<Entity*, uint32_t> oldest = m_live.front();
+				m_live.pop_front();
+
+				m_scene->removeEntity(oldest.first);
+				spawn(oldest.second);
+			}
+		}
+
+	private:
+		Scene* m_scene;
+		const RenderScenario& m_scenario;
+		uint32_t m_side;
+		std::deque<std::pair<Entity*, uint32_t>> m_live;
+	};
+
+	int runRenderBenchmark(const std::string& scenarioName, uint32_t frames, const std::string& output)
+	{
+		const RenderScenario* scenario = nullptr;
+		for (const RenderScenario& candidate : SCENARIOS)
+		{
+			if (scenarioName == candidate.name)
+				scenario = &candidate;
+		}
+
+		if (scenario == nullptr)
+		{
+			std::cout << "Unknown scenario " << scenarioName << ", expected small, large or churn" << std::endl;
+			return 1;
+		}
+
+		SystemManager* systemManager = &SystemManager::get();
+		SceneManager* sceneManager = &SceneManager::get();
+
+		std::vector<double> cpuFrameTimes;
+		std::vector<double> gpuFrameTimes;
+		std::vector<double> drawCalls;
+		std::map<std::string, std::vector<double>> systemTimes;
+		std::map<std::string, std::vector<double>> passTimes;
+
+		try
+		{
+			GraphicsSystem* graphics = new GraphicsSystem(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+			systemManager->registerSystem(graphics);
+			graphics->getRenderer()->cameraTime = 0.0f;
+
+			Scene* scene = new Scene();
+			sceneManager->setScene(scene);
+
+			BenchmarkScene bench(scene, *scenario);
+			for (uint32_t i = 0; i < scenario->count; i++)
+			{
+				bench.spawn(i);
+			}
+
+			//Meshes are loaded by the first spawn, the report shouldn't depend on how fast the copy queue is
+			graphics->getRenderer()->getDevice()->flushUploads();
+
+			Gauge* frameDrawCalls = Metrics::get().gauge("vengine_frame_draw_calls", "Draw calls in the last submitted frame");
+
+			//A frame's GPU timings are read back once its fence has signalled, when its slot comes round again. So they're
+			//taken this many frames late, and as many extra frames run at the end to read back the last measured ones.
+			uint32_t lag = graphics->getRenderer()->getFramesInFlight();
+
+			for (uint32_t frame = 0; frame < WARMUP_FRAMES + frames + lag; frame++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				bench.churn();
+				systemManager->tick();
+				auto end = std::chrono::high_resolution_clock::now();
+
+				if (frame >= WARMUP_FRAMES + lag)
+				{
+					//The frame itself first, empty if its queries couldn't be read
+					const std::vector<GpuScopeResult>& timings = graphics->getRenderer()->getGpuTimings();
+					for (size_t i = 0; i < timings.size(); i++)
+					{
+						if (i == 0)
+							gpuFrameTimes.push_back(timings[i].milliseconds);
+						else
+							passTimes[timings[i].name].push_back(timings[i].milliseconds);
+					}
+				}
+
+				if (frame < WARMUP_FRAMES || frame >= WARMUP_FRAMES + frames)
+					continue;
+
+				cpuFrameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+				drawCalls.push_back(static_cast<double>(frameDrawCalls->read()));
+
+				for (System* system : systemManager->getSystems())
+				{
+					systemTimes[system->getName()].push_back(systemManager->getTickTime(system));
+				}
+			}
+
+			vkDeviceWaitIdle(graphics->getRenderer()->getDevice()->getDevice());
+
+			sceneManager->cleanupScene();
+			systemManager->shutdown();
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+
+		std::ofstream file;
+		if (!output.empty())
+		{
+			file.open(output);
+			if (!file)
+			{
+				std::cout << "Failed to open " << output << std::endl;
+				return 1;
+			}
+		}
+		std::ostream& out = output.empty() ? std::cout : file;
+
+		out << "{\n";
+		out << "  \"scenario\": \"" << scenario->name << "\",\n";
+		out << "  \"instances\": " << scenario->count << ",\n";
+		out << "  \"churn_per_frame\": " << scenario->churn << ",\n";
+		out << "  \"frames\": " << frames << ",\n";
+		out << "  \"warmup_frames\": " << WARMUP_FRAMES << ",\n";
+		out << "  \"resolution\": [" << BENCHMARK_WIDTH << ", " << BENCHMARK_HEIGHT << "],\n";
+		out << "  \"cpu_frame_ms\": "; writeStats(out, cpuFrameTimes); out << ",\n";
+		out << "  \"gpu_frame_ms\": "; writeStats(out, gpuFrameTimes); out << ",\n";
+		out << "  \"draw_calls\": "; writeStats(out, drawCalls); out << ",\n";
+
+		out << "  \"systems_ms\": {";
+		for (auto it = systemTimes.begin(); it != systemTimes.end(); ++it)
+		{
+			out << (it == systemTimes.begin() ? "\n" : ",\n") << "    \"" << it->first << "\": ";
+			writeStats(out, it->second);
+		}
+		out << "\n  },\n";
+
+		out << "  \"gpu_passes_ms\": {";
+		for (auto it = passTimes.begin(); it != passTimes.end(); ++it)
+		{
+			out << (it == passTimes.begin() ? "\n" : ",\n") << "    \"" << it->first << "\": ";
+			writeStats(out, it->second);
+		}
+		out << "\n  }\n";
+		out << "}" << std::endl;
+
+		if (!output.empty())
+			std::cout << "Wrote " << output << std::endl;
+
+		return 0;
+	}
+}
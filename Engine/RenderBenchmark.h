@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace VEngine {
+
+	/*
+	 * Runs a scripted scene through the engine's own systems, headless, for a fixed number of frames and reports CPU frame
+	 * time, time per system, draw calls and GPU time per pass as JSON. Scenarios place their instances on a fixed grid and
+	 * the camera is pinned, so two builds given the same scenario draw the same frames and their numbers can be compared.
+	 *
+	 *   small - many instances of a small mesh
+	 *   large - a few instances of a huge mesh
+	 *   churn - small meshes, with a share of them despawned and spawned again every frame
+	 *
+	 * Run with --bench-render [scenario] [frames] [output.json], the report goes to stdout without an output file.
+	 */
+	int runRenderBenchmark(const std::string& scenario = "small", uint32_t frames = 300, const std::string& output = "");
+}
@@ -4,6 +4,14 @@
 
 #include <algorithm>
 namespace VEngine {
+	static void countDestroyed()
+	{
+		static Counter* destroyed = Metrics::get().counter("vengine_entities_destroyed_total", "Entities destroyed");
+		static Gauge* live = Metrics::get().gauge("vengine_entities_live", "Entities currently alive");
+		destroyed->add();
+		live->sub();
+	}
+
 	bool Scene::cleanup()
 	{
 		size_t count = 0;
@@ -12,6 +20,7 @@ namespace VEngine {
 			{
 				EventManager::get().emit<Events::OnEntityDestroyed>({ ent });
 				delete ent;
+				countDestroyed();
 				++count;
 				return true;
 			}
@@ -29,6 +38,7 @@ namespace VEngine {
 
 				EventManager::get().emit<Events::OnEntityDestroyed>({ ent });
 				delete ent;
+				countDestroyed();
 				++count;
 				return true;
 
@@ -49,6 +59,7 @@ namespace VEngine {
 				EventManager::get().emit<Events::OnEntityDestroyed>({ ent });
 				m_entities.erase(std::remove(m_entities.begin(), m_entities.end(), ent), m_entities.end());
 				delete ent;
+				countDestroyed();
 			}
 
 			return;
@@ -61,6 +72,7 @@ namespace VEngine {
 			EventManager::get().emit<Events::OnEntityDestroyed>({ ent });
 			m_entities.erase(std::remove(m_entities.begin(), m_entities.end(), ent), m_entities.end());
 			delete ent;
+			countDestroyed();
 		}
 	}
 }
\ No newline at end of file
@@ -25,6 +25,11 @@ namespace VEngine {
 			
 			m_entities.push_back(ent);
 
+			static Counter* created = Metrics::get().counter("vengine_entities_created_total", "Entities created");
+			static Gauge* live = Metrics::get().gauge("vengine_entities_live", "Entities currently alive");
+			created->add();
+			live->add();
+
 			EventManager::get().emit<Events::OnEntityCreated>({ ent });
 
 			return ent;
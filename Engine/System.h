@@ -12,5 +12,8 @@ namespace VEngine {
 		virtual void shutdown() = 0;
 
 		virtual void tick() = 0;
+
+		//Label for the system's tick time in vengine_system_time_ms
+		virtual const char* getName() const { return "system"; }
 	};
 }
\ No newline at end of file
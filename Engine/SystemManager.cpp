@@ -1,6 +1,11 @@
 #include "SystemManager.h"
 
 #include "SceneManager.h"
+#include "Metrics.h"
+
+#include <chrono>
+#include <string>
+
 namespace VEngine {
 
 	System* SystemManager::registerSystem(System* system)
@@ -43,9 +48,24 @@ namespace VEngine {
 		SceneManager::get().getScene()->cleanup();
 
 		for (auto* system : m_systems)
-		{			
+		{
+			auto start = std::chrono::high_resolution_clock::now();
 			system->tick();
+			auto end = std::chrono::high_resolution_clock::now();
+
+			SystemTiming& timing = m_timings[system];
+			if (timing.histogram == nullptr)
+				timing.histogram = Metrics::get().histogram("vengine_system_time_ms", { 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.7, 33.3 }, "CPU time of each system's tick", "system=\"" + std::string(system->getName()) + "\"");
+
+			timing.lastTime = std::chrono::duration<double, std::milli>(end - start).count();
+			timing.histogram->observe(timing.lastTime);
 		}
 	}
 
+	double SystemManager::getTickTime(System* system)
+	{
+		auto found = m_timings.find(system);
+		return found == m_timings.end() ? 0.0 : found->second.lastTime;
+	}
+
 }
\ No newline at end of file
@@ -12,6 +12,8 @@
 
 namespace VEngine {
 
+	class Histogram;
+
 	class SystemManager : public Manager<SystemManager>
 	{
 	public:
@@ -38,11 +40,22 @@ namespace VEngine {
 
 		void tick();
 
-		
+		//CPU time of the system's last tick in milliseconds
+		double getTickTime(System* system);
+
+		//The enabled systems, in the order tick() runs them
+		const std::vector<System*>& getSystems() { return m_systems; };
 		
 	private:
+		struct SystemTiming
+		{
+			Histogram* histogram = nullptr;
+			double lastTime = 0.0;
+		};
+
 		std::vector<System*> m_systems;
 		std::vector<System*> m_disabledSystems;
+		std::unordered_map<System*, SystemTiming> m_timings;
 	};
 
 }
@@ -0,0 +1,480 @@
+#include "VulkanAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "Metrics.h"
+
+namespace VEngine {
+
+	static uint32_t orderForSize(VkDeviceSize size)
+	{
+		uint32_t order = 0;
+		while ((MIN_SUBALLOCATION_SIZE << order) < size)
+		{
+			++order;
+		}
+		return order;
+	}
+
+	static VkDeviceSize roundDownPow2(VkDeviceSize value)
+	{
+		VkDeviceSize result = 1;
+		while (result * 2 <= value)
+		{
+			result *= 2;
+		}
+		return result;
+	}
+
+	void VulkanAllocator::init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits)
+	{
+		m_device = device;
+		m_memoryProperties = memoryProperties;
+		m_nonCoherentAtomSize = std::max<VkDeviceSize>(limits.nonCoherentAtomSize, 1);
+		m_maxAllocationCount = limits.maxMemoryAllocationCount;
+	}
+
+	void VulkanAllocator::destroy()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (auto& kv : m_pools)
+		{
+			for (auto& block : kv.second.blocks)
+			{
+				if (!block->allocated.empty())
+				{
+					WLOG("Destroying a memory block with ", block->allocated.size(), " live allocations!");
+				}
+
+				if (block->mapped)
+				{
+					vkUnmapMemory(m_device, block->memory);
+				}
+				vkFreeMemory(m_device, block->memory, nullptr);
+			}
+		}
+
+		m_pools.clear();
+		m_deviceAllocationCount = 0;
+		updateMetrics();
+	}
+
+	VkDeviceSize VulkanAllocator::preferredBlockSize(uint32_t memoryType)
+	{
+		//Small heaps (such as the 256MB host visible device local heap) get proportionally smaller blocks
+		VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+		if (heapSize <= 1024ull * 1024 * 1024)
+		{
+			return std::max(MIN_SUBALLOCATION_SIZE, roundDownPow2(heapSize / 8));
+		}
+
+		return DEFAULT_BLOCK_SIZE;
+	}
+
+	VulkanAllocator::Block* VulkanAllocator::createBlock(uint32_t memoryType, uint32_t poolKey, VkDeviceSize size, bool dedicated)
+	{
+		if (m_deviceAllocationCount + 1 > m_maxAllocationCount)
+		{
+			ELOG("Exceeded maxMemoryAllocationCount!");
+			throw std::runtime_error("Exceeded maxMemoryAllocationCount!");
+		}
+
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		std::unique_ptr<Block> block(new Block());
+		if (vkAllocateMemory(m_device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+			ELOG("Failed to allocate device memory block!");
+			throw std::runtime_error("Failed to allocate device memory block!");
+		}
+
+		block->size = size;
+		block->memoryType = memoryType;
+		block->poolKey = poolKey;
+		block->dedicated = dedicated;
+
+		//Host visible blocks stay mapped for their whole life, sub-allocations share the one mapping
+		if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			if (vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+				ELOG("Failed to map device memory block!");
+				throw std::runtime_error("Failed to map device memory block!");
+			}
+		}
+
+		if (!dedicated)
+		{
+			block->maxOrder = orderForSize(size);
+			block->freeLists.resize(block->maxOrder + 1);
+			block->freeLists[block->maxOrder].insert(0);
+		}
+
+		++m_deviceAllocationCount;
+
+		static Counter* allocations = Metrics::get().counter("vengine_gpu_allocations_total", "Device memory allocations made with vkAllocateMemory");
+		static Counter* allocatedBytes = Metrics::get().counter("vengine_gpu_allocated_bytes_total", "Bytes of device memory allocated");
+		allocations->add();
+		allocatedBytes->add(static_cast<int64_t>(size));
+
+		Block* result = block.get();
+		m_pools[poolKey].blocks.push_back(std::move(block));
+		return result;
+	}
+
+	void VulkanAllocator::destroyBlock(Block* block)
+	{
+		if (block->mapped)
+		{
+			vkUnmapMemory(m_device, block->memory);
+		}
+		vkFreeMemory(m_device, block->memory, nullptr);
+		--m_deviceAllocationCount;
+
+		auto& blocks = m_pools[block->poolKey].blocks;
+		blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [block](const std::unique_ptr<Block>& b) { return b.get() == block; }), blocks.end());
+	}
+
+	bool VulkanAllocator::allocateFromBlock(Block* block, VkDeviceSize size, VkDeviceSize alignment, void* userData, VulkanAllocation& allocation)
+	{
+		//Buddies are aligned to their own size, so rounding up to the alignment satisfies it for free
+		uint32_t order = orderForSize(std::max(size, alignment));
+		if (order > block->maxOrder)
+			return false;
+
+		uint32_t found = order;
+		while (found <= block->maxOrder && block->freeLists[found].empty())
+		{
+			++found;
+		}
+
+		if (found > block->maxOrder)
+			return false;
+
+		VkDeviceSize offset = *block->freeLists[found].begin();
+		block->freeLists[found].erase(block->freeLists[found].begin());
+
+		//Split the larger buddy down, returning the upper halves to the free lists
+		while (found > order)
+		{
+			--found;
+			block->freeLists[found].insert(offset + (MIN_SUBALLOCATION_SIZE << found));
+		}
+
+		block->allocated[offset] = { order, size, userData };
+		block->used += MIN_SUBALLOCATION_SIZE << order;
+		block->requested += size;
+
+		allocation.memory = block->memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.memoryType = block->memoryType;
+		allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+		allocation.userData = userData;
+		allocation.block = block;
+		return true;
+	}
+
+	void VulkanAllocator::freeFromBlock(Block* block, VkDeviceSize offset)
+	{
+		auto found = block->allocated.find(offset);
+		if (found == block->allocated.end())
+		{
+			WLOG("Freeing an allocation that doesn't belong to its block!");
+			return;
+		}
+
+		uint32_t order = found->second.order;
+		block->used -= MIN_SUBALLOCATION_SIZE << order;
+		block->requested -= found->second.requested;
+		block->allocated.erase(found);
+
+		//Merge with the buddy for as long as it's also free
+		while (order < block->maxOrder)
+		{
+			VkDeviceSize buddy = offset ^ (MIN_SUBALLOCATION_SIZE << order);
+			auto buddyIt = block->freeLists[order].find(buddy);
+			if (buddyIt == block->freeLists[order].end())
+				break;
+
+			block->freeLists[order].erase(buddyIt);
+			offset = std::min(offset, buddy);
+			++order;
+		}
+
+		block->freeLists[order].insert(offset);
+	}
+
+	VulkanAllocation VulkanAllocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, AllocationKind kind, void* userData)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		uint32_t poolKey = memoryType * 2 + (kind == AllocationKind::Optimal ? 1 : 0);
+		Pool& pool = m_pools[poolKey];
+		pool.blockSize = preferredBlockSize(memoryType);
+
+		VulkanAllocation allocation;
+
+		//Anything over half a block would waste most of one, give it its own memory instead
+		if (requirements.size > pool.blockSize / 2)
+		{
+			Block* block = createBlock(memoryType, poolKey, requirements.size, true);
+			block->used = block->requested = requirements.size;
+
+			allocation.memory = block->memory;
+			allocation.offset = 0;
+			allocation.size = requirements.size;
+			allocation.memoryType = memoryType;
+			allocation.mapped = block->mapped;
+			allocation.userData = userData;
+			allocation.block = block;
+
+			updateMetrics();
+			return allocation;
+		}
+
+		for (auto& block : pool.blocks)
+		{
+			if (!block->dedicated && allocateFromBlock(block.get(), requirements.size, requirements.alignment, userData, allocation))
+			{
+				updateMetrics();
+				return allocation;
+			}
+		}
+
+		Block* block = createBlock(memoryType, poolKey, pool.blockSize, false);
+		if (!allocateFromBlock(block, requirements.size, requirements.alignment, userData, allocation))
+		{
+			ELOG("Failed to sub-allocate from a new memory block!");
+			throw std::runtime_error("Failed to sub-allocate from a new memory block!");
+		}
+
+		updateMetrics();
+		return allocation;
+	}
+
+	void VulkanAllocator::free(VulkanAllocation& allocation)
+	{
+		if (!allocation.isValid())
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		Block* block = static_cast<Block*>(allocation.block);
+		if (block->dedicated)
+		{
+			destroyBlock(block);
+		}
+		else
+		{
+			freeFromBlock(block, allocation.offset);
+
+			//Keep one empty block per pool around so allocation churn doesn't hit vkAllocateMemory every time
+			if (block->allocated.empty())
+			{
+				auto& blocks = m_pools[block->poolKey].blocks;
+				bool otherEmpty = std::any_of(blocks.begin(), blocks.end(), [block](const std::unique_ptr<Block>& b) {
+					return b.get() != block && !b->dedicated && b->allocated.empty();
+				});
+
+				if (otherEmpty)
+				{
+					destroyBlock(block);
+				}
+			}
+		}
+
+		allocation = VulkanAllocation();
+		updateMetrics();
+	}
+
+	VkMappedMemoryRange VulkanAllocator::alignedRange(const VulkanAllocation& allocation, VkDeviceSize size, VkDeviceSize offset)
+	{
+		Block* block = static_cast<Block*>(allocation.block);
+
+		if (size == VK_WHOLE_SIZE)
+		{
+			size = allocation.size - offset;
+		}
+
+		//Ranges have to be multiples of nonCoherentAtomSize, widen to cover the atoms the write touched
+		VkDeviceSize begin = allocation.offset + offset;
+		VkDeviceSize end = begin + size;
+		begin = (begin / m_nonCoherentAtomSize) * m_nonCoherentAtomSize;
+		end = std::min(((end + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize) * m_nonCoherentAtomSize, block->size);
+
+		VkMappedMemoryRange mappedRange = {};
+		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		mappedRange.memory = allocation.memory;
+		mappedRange.offset = begin;
+		mappedRange.size = end == block->size ? VK_WHOLE_SIZE : end - begin;
+		return mappedRange;
+	}
+
+	VkResult VulkanAllocator::flush(const VulkanAllocation& allocation, VkDeviceSize size, VkDeviceSize offset)
+	{
+		VkMappedMemoryRange mappedRange = alignedRange(allocation, size, offset);
+		return vkFlushMappedMemoryRanges(m_device, 1, &mappedRange);
+	}
+
+	VkResult VulkanAllocator::invalidate(const VulkanAllocation& allocation, VkDeviceSize size, VkDeviceSize offset)
+	{
+		VkMappedMemoryRange mappedRange = alignedRange(allocation, size, offset);
+		return vkInvalidateMappedMemoryRanges(m_device, 1, &mappedRange);
+	}
+
+	uint32_t VulkanAllocator::defragment(const MoveCallback& move, VkDeviceSize maxBytesToMove)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		uint32_t moved = 0;
+		VkDeviceSize bytesMoved = 0;
+
+		for (auto& kv : m_pools)
+		{
+			std::vector<Block*> candidates;
+			for (auto& block : kv.second.blocks)
+			{
+				if (!block->dedicated)
+					candidates.push_back(block.get());
+			}
+
+			if (candidates.size() < 2)
+				continue;
+
+			//Drain the emptiest block into the fullest ones
+			std::sort(candidates.begin(), candidates.end(), [](Block* a, Block* b) { return a->used < b->used; });
+			Block* source = candidates.front();
+
+			std::vector<std::pair<VkDeviceSize, Suballocation>> movable;
+			for (auto& alloc : source->allocated)
+			{
+				if (alloc.second.userData)
+					movable.push_back(alloc);
+			}
+
+			for (auto& alloc : movable)
+			{
+				if (maxBytesToMove != VK_WHOLE_SIZE && bytesMoved + alloc.second.requested > maxBytesToMove)
+					break;
+
+				VulkanAllocation from;
+				from.memory = source->memory;
+				from.offset = alloc.first;
+				from.size = alloc.second.requested;
+				from.memoryType = source->memoryType;
+				from.mapped = source->mapped ? static_cast<char*>(source->mapped) + alloc.first : nullptr;
+				from.userData = alloc.second.userData;
+				from.block = source;
+
+				VulkanAllocation to;
+				bool placed = false;
+				for (auto it = candidates.rbegin(); it != candidates.rend() && !placed; ++it)
+				{
+					if (*it != source)
+						placed = allocateFromBlock(*it, from.size, MIN_SUBALLOCATION_SIZE << alloc.second.order, from.userData, to);
+				}
+
+				if (!placed)
+					break;
+
+				if (move(from, to))
+				{
+					freeFromBlock(source, from.offset);
+					bytesMoved += from.size;
+					++moved;
+				}
+				else
+				{
+					freeFromBlock(static_cast<Block*>(to.block), to.offset);
+				}
+			}
+
+			if (source->allocated.empty())
+			{
+				destroyBlock(source);
+			}
+		}
+
+		updateMetrics();
+		return moved;
+	}
+
+	std::map<uint32_t, VulkanMemoryStats> VulkanAllocator::getStatsPerMemoryType()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		std::map<uint32_t, VulkanMemoryStats> stats;
+		for (auto& kv : m_pools)
+		{
+			for (auto& block : kv.second.blocks)
+			{
+				VulkanMemoryStats& typeStats = stats[block->memoryType];
+				typeStats.blockCount++;
+				typeStats.reservedBytes += block->size;
+				typeStats.usedBytes += block->used;
+				typeStats.requestedBytes += block->requested;
+				if (block->dedicated)
+				{
+					typeStats.dedicatedAllocationCount++;
+					typeStats.allocationCount++;
+				}
+				else
+				{
+					typeStats.allocationCount += static_cast<uint32_t>(block->allocated.size());
+				}
+			}
+		}
+
+		return stats;
+	}
+
+	VulkanMemoryStats VulkanAllocator::getStats()
+	{
+		VulkanMemoryStats total;
+		for (auto& kv : getStatsPerMemoryType())
+		{
+			total.blockCount += kv.second.blockCount;
+			total.allocationCount += kv.second.allocationCount;
+			total.dedicatedAllocationCount += kv.second.dedicatedAllocationCount;
+			total.reservedBytes += kv.second.reservedBytes;
+			total.usedBytes += kv.second.usedBytes;
+			total.requestedBytes += kv.second.requestedBytes;
+		}
+		return total;
+	}
+
+	void VulkanAllocator::logStats()
+	{
+		for (auto& kv : getStatsPerMemoryType())
+		{
+			LOG("Memory type ", kv.first, ": ", kv.second.blockCount, " blocks, ", kv.second.allocationCount, " allocations, ",
+				kv.second.requestedBytes, " requested / ", kv.second.usedBytes, " used / ", kv.second.reservedBytes, " reserved bytes");
+		}
+	}
+
+	void VulkanAllocator::updateMetrics()
+	{
+		static Gauge* blocks = Metrics::get().gauge("vengine_gpu_memory_blocks", "Live device memory objects owned by the allocator");
+		static Gauge* reserved = Metrics::get().gauge("vengine_gpu_memory_reserved_bytes", "Device memory reserved in blocks");
+		static Gauge* used = Metrics::get().gauge("vengine_gpu_memory_used_bytes", "Device memory handed out to resources");
+
+		VkDeviceSize reservedBytes = 0, usedBytes = 0;
+		for (auto& kv : m_pools)
+		{
+			for (auto& block : kv.second.blocks)
+			{
+				reservedBytes += block->size;
+				usedBytes += block->used;
+			}
+		}
+
+		blocks->set(m_deviceAllocationCount);
+		reserved->set(static_cast<int64_t>(reservedBytes));
+		used->set(static_cast<int64_t>(usedBytes));
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace VEngine {
+
+	//Smallest piece of a block the buddy allocator hands out, every allocation is rounded up to a power of two of this
+	const static VkDeviceSize MIN_SUBALLOCATION_SIZE = 256;
+	const static VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+	enum class AllocationKind
+	{
+		Linear,	//Buffers and linear images
+		Optimal	//Optimally tiled images, kept in separate blocks so bufferImageGranularity never applies
+	};
+
+	struct VulkanAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memoryType = 0;
+
+		//Points into the block's persistent mapping, null for memory that isn't host visible
+		void* mapped = nullptr;
+
+		//Allocations that carry user data may be moved by defragment()
+		void* userData = nullptr;
+
+		//Owning block, opaque to users
+		void* block = nullptr;
+
+		bool isValid() const { return memory != VK_NULL_HANDLE; };
+	};
+
+	struct VulkanMemoryStats
+	{
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+		uint32_t dedicatedAllocationCount = 0;
+		VkDeviceSize reservedBytes = 0;		//Sum of all VkDeviceMemory objects
+		VkDeviceSize usedBytes = 0;			//Bytes handed out after rounding
+		VkDeviceSize requestedBytes = 0;	//Bytes actually asked for
+	};
+
+	class VulkanAllocator
+	{
+	public:
+		void init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits);
+		void destroy();
+
+		VulkanAllocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, AllocationKind kind, void* userData = nullptr);
+		void free(VulkanAllocation& allocation);
+
+		VkResult flush(const VulkanAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+		VkResult invalidate(const VulkanAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+		//Tries to empty the least used block of each pool by moving its movable allocations (those with userData) elsewhere.
+		//The callback must copy the contents and rebind its resource to the new allocation, returning false to keep the old one.
+		//Blocks that end up empty are released. Returns the number of allocations moved.
+		typedef std::function<bool(const VulkanAllocation& from, const VulkanAllocation& to)> MoveCallback;
+		uint32_t defragment(const MoveCallback& move, VkDeviceSize maxBytesToMove = VK_WHOLE_SIZE);
+
+		VulkanMemoryStats getStats();
+		std::map<uint32_t, VulkanMemoryStats> getStatsPerMemoryType();
+		void logStats();
+
+	private:
+		struct Suballocation
+		{
+			uint32_t order;
+			VkDeviceSize requested;
+			void* userData;
+		};
+
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32_t memoryType = 0;
+			uint32_t poolKey = 0;
+			bool dedicated = false;
+			void* mapped = nullptr;
+
+			uint32_t maxOrder = 0;
+			std::vector<std::set<VkDeviceSize>> freeLists;
+			std::map<VkDeviceSize, Suballocation> allocated;
+			VkDeviceSize used = 0;
+			VkDeviceSize requested = 0;
+		};
+
+		struct Pool
+		{
+			VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE;
+			std::vector<std::unique_ptr<Block>> blocks;
+		};
+
+		Block* createBlock(uint32_t memoryType, uint32_t poolKey, VkDeviceSize size, bool dedicated);
+		void destroyBlock(Block* block);
+
+		bool allocateFromBlock(Block* block, VkDeviceSize size, VkDeviceSize alignment, void* userData, VulkanAllocation& allocation);
+		void freeFromBlock(Block* block, VkDeviceSize offset);
+
+		VkDeviceSize preferredBlockSize(uint32_t memoryType);
+		VkMappedMemoryRange alignedRange(const VulkanAllocation& allocation, VkDeviceSize size, VkDeviceSize offset);
+
+		void updateMetrics();
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+		VkDeviceSize m_nonCoherentAtomSize = 1;
+		uint32_t m_maxAllocationCount = 4096;
+
+		std::map<uint32_t, Pool> m_pools;
+		uint32_t m_deviceAllocationCount = 0;
+
+		std::mutex m_mutex;
+	};
+}
@@ -0,0 +1,163 @@
+#include "VulkanBindless.h"
+#include "VulkanDevice.h"
+
+#include <algorithm>
+#include <array>
+
+namespace VEngine {
+
+	uint32_t VulkanBindless::SlotList::take()
+	{
+		if (!released.empty())
+		{
+			uint32_t index = released.back();
+			released.pop_back();
+			return index;
+		}
+
+		if (next >= capacity) {
+			ELOG("Bindless descriptor array is full!");
+			throw std::runtime_error("Bindless descriptor array is full!");
+		}
+
+		return next++;
+	}
+
+	void VulkanBindless::create(VulkanDevice* device)
+	{
+		m_device = device;
+
+		//The limits count set 0's descriptors too, so some room is left for them
+		const uint32_t reserved = 16;
+
+		m_textures = SlotList();
+		m_textures.capacity = std::min(MAX_BINDLESS_TEXTURES, device->getMaxBindlessTextures() - std::min(reserved, device->getMaxBindlessTextures()));
+		m_buffers = SlotList();
+		m_buffers.capacity = std::min(MAX_BINDLESS_BUFFERS, device->getMaxBindlessBuffers() - std::min(reserved, device->getMaxBindlessBuffers()));
+
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = m_textures.capacity;
+		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[1].descriptorCount = m_buffers.capacity;
+		bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		std::array<VkDescriptorBindingFlagsEXT, 2> bindingFlags = {};
+		bindingFlags[0] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+		bindingFlags[1] = bindingFlags[0];
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo = {};
+		flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+		flagsInfo.pBindingFlags = bindingFlags.data();
+
+		//Created here rather than through the layout cache, which has no way to carry binding flags
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &flagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(m_device->getDevice(), &layoutInfo, nullptr, &m_layout) != VK_SUCCESS) {
+			ELOG("Failed to create descriptor set layout!");
+			throw std::runtime_error("Failed to create descriptor set layout!");
+		}
+
+		std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[0].descriptorCount = m_textures.capacity;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[1].descriptorCount = m_buffers.capacity;
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = 1;
+
+		if (vkCreateDescriptorPool(m_device->getDevice(), &poolInfo, nullptr, &m_pool) != VK_SUCCESS) {
+			ELOG("Failed to create descriptor pool!");
+			throw std::runtime_error("Failed to create descriptor pool!");
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &m_layout;
+
+		if (vkAllocateDescriptorSets(m_device->getDevice(), &allocInfo, &m_set) != VK_SUCCESS) {
+			ELOG("Failed to allocate descriptor sets!");
+			throw std::runtime_error("Failed to allocate descriptor sets!");
+		}
+	}
+
+	void VulkanBindless::destroy()
+	{
+		if (m_device == nullptr)
+			return;
+
+		vkDestroyDescriptorPool(m_device->getDevice(), m_pool, nullptr);
+		vkDestroyDescriptorSetLayout(m_device->getDevice(), m_layout, nullptr);
+
+		m_pool = VK_NULL_HANDLE;
+		m_layout = VK_NULL_HANDLE;
+		m_set = VK_NULL_HANDLE;
+		m_device = nullptr;
+	}
+
+	uint32_t VulkanBindless::addTexture(VkImageView view, VkSampler sampler, VkImageLayout layout)
+	{
+		uint32_t index = m_textures.take();
+
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = layout;
+		imageInfo.imageView = view;
+		imageInfo.sampler = sampler;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_set;
+		write.dstBinding = 0;
+		write.dstArrayElement = index;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets(m_device->getDevice(), 1, &write, 0, nullptr);
+		return index;
+	}
+
+	uint32_t VulkanBindless::addBuffer(const VkDescriptorBufferInfo& buffer)
+	{
+		uint32_t index = m_buffers.take();
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_set;
+		write.dstBinding = 1;
+		write.dstArrayElement = index;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.descriptorCount = 1;
+		write.pBufferInfo = &buffer;
+
+		vkUpdateDescriptorSets(m_device->getDevice(), 1, &write, 0, nullptr);
+		return index;
+	}
+
+	void VulkanBindless::releaseTexture(uint32_t index)
+	{
+		m_textures.released.push_back(index);
+	}
+
+	void VulkanBindless::releaseBuffer(uint32_t index)
+	{
+		m_buffers.released.push_back(index);
+	}
+}
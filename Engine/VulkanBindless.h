@@ -0,0 +1,57 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+namespace VEngine {
+
+	class VulkanDevice;
+
+	//Slots asked for, the device's update after bind limits may lower them
+	const static uint32_t MAX_BINDLESS_TEXTURES = 4096;
+	const static uint32_t MAX_BINDLESS_BUFFERS = 1024;
+
+	/*
+	 * One descriptor set holding every texture and storage buffer in large arrays, bound once per command buffer as set 1.
+	 * Draws pick their texture by an index in their object data, so meshes with different textures draw back to back
+	 * without switching descriptor sets.
+	 *
+	 * Built on VK_EXT_descriptor_indexing: the arrays are partially bound, so unused slots can stay empty, and written
+	 * with update after bind, so adding a texture never waits on frames in flight. A released slot is only handed out
+	 * again once nothing can still be reading it, which the caller makes sure of by deferring release().
+	 */
+	class VulkanBindless
+	{
+	public:
+		void create(VulkanDevice* device);
+		void destroy();
+
+		VkDescriptorSetLayout getLayout() { return m_layout; };
+		VkDescriptorSet getSet() { return m_set; };
+
+		uint32_t addTexture(VkImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		uint32_t addBuffer(const VkDescriptorBufferInfo& buffer);
+
+		void releaseTexture(uint32_t index);
+		void releaseBuffer(uint32_t index);
+
+	private:
+		struct SlotList
+		{
+			uint32_t capacity = 0;
+			uint32_t next = 0;
+			std::vector<uint32_t> released;
+
+			uint32_t take();
+		};
+
+		VulkanDevice* m_device = nullptr;
+
+		VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+		VkDescriptorPool m_pool = VK_NULL_HANDLE;
+		VkDescriptorSet m_set = VK_NULL_HANDLE;
+
+		SlotList m_textures;
+		SlotList m_buffers;
+	};
+}
@@ -2,21 +2,24 @@
 namespace VEngine {
 	VkResult VulkanBuffer::map(VkDeviceSize size, VkDeviceSize offset)
 	{
-		return vkMapMemory(m_device, m_memory, offset, size, 0, &m_mapped);
+		//Host visible blocks are persistently mapped by the allocator, mapping is just pointer arithmetic
+		if (!m_allocation.mapped)
+		{
+			return VK_ERROR_MEMORY_MAP_FAILED;
+		}
+
+		m_mapped = static_cast<char*>(m_allocation.mapped) + offset;
+		return VK_SUCCESS;
 	}
 
 	void VulkanBuffer::unmap()
 	{
-		if (m_mapped)
-		{
-			vkUnmapMemory(m_device, m_memory);
-			m_mapped = nullptr;
-		}
+		m_mapped = nullptr;
 	}
 
 	VkResult VulkanBuffer::bind(VkDeviceSize offset)
 	{
-		return vkBindBufferMemory(m_device, m_buffer, m_memory, offset);
+		return vkBindBufferMemory(m_device, m_buffer, m_allocation.memory, m_allocation.offset + offset);
 	}
 
 	void VulkanBuffer::setupDescriptor(VkDeviceSize size, VkDeviceSize offset)
@@ -34,22 +37,12 @@ namespace VEngine {
 
 	VkResult VulkanBuffer::flush(VkDeviceSize size, VkDeviceSize offset)
 	{
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = m_memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
-		return vkFlushMappedMemoryRanges(m_device, 1, &mappedRange);
+		return m_allocator->flush(m_allocation, size, offset);
 	}
 
 	VkResult VulkanBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset)
 	{
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = m_memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
-		return vkInvalidateMappedMemoryRanges(m_device, 1, &mappedRange);
+		return m_allocator->invalidate(m_allocation, size, offset);
 	}
 
 	void VulkanBuffer::destroy()
@@ -57,10 +50,12 @@ namespace VEngine {
 		if (m_buffer)
 		{
 			vkDestroyBuffer(m_device, m_buffer, nullptr);
+			m_buffer = VK_NULL_HANDLE;
 		}
-		if (m_memory)
+		if (m_allocator)
 		{
-			vkFreeMemory(m_device, m_memory, nullptr);
+			m_allocator->free(m_allocation);
 		}
+		m_mapped = nullptr;
 	}
-}
\ No newline at end of file
+}
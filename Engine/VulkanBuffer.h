@@ -2,6 +2,8 @@
 #include <vulkan/vulkan.h>
 #include <assert.h>
 #include <memory>
+
+#include "VulkanAllocator.h"
 namespace VEngine {
 	class VulkanBuffer
 	{
@@ -9,13 +11,11 @@ namespace VEngine {
 		VulkanBuffer(VkDevice device) {
 			m_device = device;
 			m_buffer = VK_NULL_HANDLE;
-			m_memory = VK_NULL_HANDLE;
 			m_mapped = nullptr;
 		};
 
 		VulkanBuffer() {
 			m_buffer = VK_NULL_HANDLE;
-			m_memory = VK_NULL_HANDLE;
 			m_mapped = nullptr;
 		};
 
@@ -37,8 +37,11 @@ namespace VEngine {
 		VkDevice getDevice() { return m_device; };
 		void setDevice(VkDevice device) { m_device = device; }
 
+		void setAllocation(VulkanAllocator* allocator, const VulkanAllocation& allocation) { m_allocator = allocator; m_allocation = allocation; };
+		VulkanAllocation& getAllocation() { return m_allocation; };
+
 		VkBuffer& getBuffer() { return m_buffer; };
-		VkBuffer& getMemory() { return m_memory; };
+		VkDeviceMemory& getMemory() { return m_allocation.memory; };
 
 		void* getMapped() { return m_mapped; };
 
@@ -51,7 +54,10 @@ namespace VEngine {
 
 		VkDevice m_device;
 		VkBuffer m_buffer = VK_NULL_HANDLE;
-		VkDeviceMemory m_memory = VK_NULL_HANDLE;
+
+		//Memory is sub-allocated from a shared block, offsets below are relative to the allocation
+		VulkanAllocator* m_allocator = nullptr;
+		VulkanAllocation m_allocation;
 
 		VkDescriptorBufferInfo m_descriptor;
 		VkDeviceSize m_size = 0;
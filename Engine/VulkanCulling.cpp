@@ -0,0 +1,549 @@
+#include "VulkanCulling.h"
+#include "VulkanDevice.h"
+#include "FrustumCulling.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+
+namespace VEngine {
+
+	struct PyramidConstants {
+		int32_t srcWidth;
+		int32_t srcHeight;
+		int32_t dstWidth;
+		int32_t dstHeight;
+		int32_t samples;
+	};
+
+	bool VulkanCulling::create(VulkanDevice* device, uint32_t frameCount, VkExtent2D extent, VkImageView depthView, VkFormat depthFormat, VkSampleCountFlagBits depthSamples,
+		VulkanPerFrameBuffer* objectBuffer, VulkanPerFrameBuffer* indirectBuffer, VulkanPerFrameBuffer* visibleBuffer)
+	{
+		m_device = device;
+		m_frameCount = frameCount;
+		m_depthFormat = depthFormat;
+		m_framesCulled = 0;
+		m_objectBuffer = objectBuffer;
+		m_indirectBuffer = indirectBuffer;
+		m_visibleBuffer = visibleBuffer;
+
+		//The cull pass writes instance counts the CPU never sees, so it needs indirect draws starting at each batch's first instance
+		if (!device->supportsDrawIndirectFirstInstance())
+		{
+			WLOG("Indirect draws can't start past instance 0, GPU culling disabled!");
+			m_enabled = false;
+			return false;
+		}
+
+		std::string depthShader = depthSamples == VK_SAMPLE_COUNT_1_BIT ? "resources/shaders/hiz_depth.spv" : "resources/shaders/hiz_depth_ms.spv";
+		for (const std::string& file : { std::string("resources/shaders/cull.spv"), std::string("resources/shaders/hiz_reduce.spv"), depthShader })
+		{
+			std::ifstream shader(file);
+			if (!shader.is_open())
+			{
+				WLOG("Culling shaders haven't been compiled, GPU culling disabled!");
+				m_enabled = false;
+				return false;
+			}
+		}
+
+		uint32_t maxObjects = static_cast<uint32_t>(visibleBuffer->getFrameSize() / sizeof(uint32_t));
+		uint32_t maxBatches = static_cast<uint32_t>(indirectBuffer->getFrameSize() / sizeof(VkDrawIndexedIndirectCommand));
+
+		m_paramsBuffer.create(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(CullParams), frameCount);
+		m_objectBatchBuffer.create(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * maxObjects, frameCount);
+		m_batchBuffer.create(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(CullBatch) * maxBatches, frameCount);
+		m_dispatchBuffer.create(device, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(VkDispatchIndirectCommand), frameCount);
+
+		createPyramid(extent);
+
+		VkSamplerCreateInfo samplerInfo = {};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.minLod = 0;
+		//Left to the view's level count, which changes with the size
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(device->getDevice(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS) {
+			ELOG("Failed to create depth pyramid sampler!");
+			throw std::runtime_error("Failed to create depth pyramid sampler!");
+		}
+
+		m_cullSetLayout = createSetLayout({
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,			//Cull params
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			//Objects
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			//Object batches
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			//Batches
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			//Indirect commands
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			//Visible objects
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER	//Depth pyramid
+		});
+
+		m_pyramidSetLayout = createSetLayout({
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	//Depth buffer or the level above
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE			//Level being written
+		});
+
+		VkPipelineLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &m_cullSetLayout;
+
+		if (vkCreatePipelineLayout(device->getDevice(), &layoutInfo, nullptr, &m_cullLayout) != VK_SUCCESS) {
+			ELOG("Failed to create pipeline layout!");
+			throw std::runtime_error("Failed to create pipeline layout!");
+		}
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PyramidConstants);
+
+		layoutInfo.pSetLayouts = &m_pyramidSetLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(device->getDevice(), &layoutInfo, nullptr, &m_pyramidLayout) != VK_SUCCESS) {
+			ELOG("Failed to create pipeline layout!");
+			throw std::runtime_error("Failed to create pipeline layout!");
+		}
+
+		VkShaderModule cullModule = loadShader("resources/shaders/cull.spv");
+		VkShaderModule depthModule = loadShader(depthShader);
+		VkShaderModule reduceModule = loadShader("resources/shaders/hiz_reduce.spv");
+
+		m_cullPipeline = createComputePipeline(cullModule, m_cullLayout);
+		m_depthPipeline = createComputePipeline(depthModule, m_pyramidLayout);
+		m_reducePipeline = createComputePipeline(reduceModule, m_pyramidLayout);
+
+		vkDestroyShaderModule(device->getDevice(), cullModule, nullptr);
+		vkDestroyShaderModule(device->getDevice(), depthModule, nullptr);
+		vkDestroyShaderModule(device->getDevice(), reduceModule, nullptr);
+
+		createDescriptorSets(depthView, objectBuffer, indirectBuffer, visibleBuffer);
+
+		m_enabled = true;
+		return true;
+	}
+
+	void VulkanCulling::destroy()
+	{
+		if (!m_enabled)
+			return;
+
+		VkDevice device = m_device->getDevice();
+
+		vkDestroyPipeline(device, m_cullPipeline, nullptr);
+		vkDestroyPipeline(device, m_depthPipeline, nullptr);
+		vkDestroyPipeline(device, m_reducePipeline, nullptr);
+		vkDestroyPipelineLayout(device, m_cullLayout, nullptr);
+		vkDestroyPipelineLayout(device, m_pyramidLayout, nullptr);
+		vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+		vkDestroySampler(device, m_sampler, nullptr);
+		destroyPyramid();
+
+		m_paramsBuffer.destroy();
+		m_objectBatchBuffer.destroy();
+		m_batchBuffer.destroy();
+		m_dispatchBuffer.destroy();
+
+		m_cullSets.clear();
+		m_pyramidSets.clear();
+		m_enabled = false;
+	}
+
+	std::function<void()> VulkanCulling::resize(VkExtent2D extent, VkImageView depthView)
+	{
+		if (!m_enabled)
+			return []() {};
+
+		VkDevice device = m_device->getDevice();
+		VulkanAllocator* allocator = m_device->getAllocator();
+		VkDescriptorPool oldPool = m_descriptorPool;
+		VkImage oldPyramid = m_pyramid;
+		VulkanAllocation oldAllocation = m_pyramidAllocation;
+		VkImageView oldView = m_pyramidView;
+		std::vector<VkImageView> oldLevels;
+		oldLevels.swap(m_pyramidLevels);
+
+		//The pool is sized by the level count, so the sets are made again along with it
+		createPyramid(extent);
+		createDescriptorSets(depthView, m_objectBuffer, m_indirectBuffer, m_visibleBuffer);
+
+		//Nothing has been drawn into the new pyramid yet, so the next frame skips the occlusion test
+		m_framesCulled = 0;
+
+		return [device, allocator, oldPool, oldPyramid, oldAllocation, oldView, oldLevels]() mutable {
+			for (VkImageView view : oldLevels)
+			{
+				vkDestroyImageView(device, view, nullptr);
+			}
+			vkDestroyImageView(device, oldView, nullptr);
+			vkDestroyImage(device, oldPyramid, nullptr);
+			allocator->free(oldAllocation);
+			vkDestroyDescriptorPool(device, oldPool, nullptr);
+		};
+	}
+
+	VkShaderModule VulkanCulling::loadShader(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			ELOG("Failed to open file!");
+			throw std::runtime_error("Failed to open file!");
+		}
+
+		size_t fileSize = (size_t)file.tellg();
+		std::vector<char> code(fileSize);
+		file.seekg(0);
+		file.read(code.data(), fileSize);
+
+		VkShaderModuleCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = code.size();
+		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+		VkShaderModule shaderModule;
+		if (vkCreateShaderModule(m_device->getDevice(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+			ELOG("Failed to create shader module!");
+			throw std::runtime_error("Failed to create shader module!");
+		}
+
+		return shaderModule;
+	}
+
+	VkPipeline VulkanCulling::createComputePipeline(VkShaderModule module, VkPipelineLayout layout)
+	{
+		VkComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = module;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = layout;
+
+		VkPipeline pipeline;
+		if (vkCreateComputePipelines(m_device->getDevice(), m_device->getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+			ELOG("Failed to create compute pipeline!");
+			throw std::runtime_error("Failed to create compute pipeline!");
+		}
+
+		return pipeline;
+	}
+
+	VkDescriptorSetLayout VulkanCulling::createSetLayout(const std::vector<VkDescriptorType>& types)
+	{
+		std::vector<VkDescriptorSetLayoutBinding> bindings(types.size());
+		for (uint32_t i = 0; i < types.size(); i++)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorCount = 1;
+			bindings[i].descriptorType = types[i];
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		//Owned by the device's cache, so a resize recreating the culling gets the same layouts back
+		return m_device->getLayoutCache()->getLayout(bindings);
+	}
+
+	void VulkanCulling::createPyramid(VkExtent2D extent)
+	{
+		m_pyramidExtent = extent;
+		uint32_t levels = static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;
+
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = extent.width;
+		imageInfo.extent.height = extent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = levels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateImage(m_device->getDevice(), &imageInfo, nullptr, &m_pyramid) != VK_SUCCESS) {
+			ELOG("Failed to create image!");
+			throw std::runtime_error("Failed to create image!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(m_device->getDevice(), m_pyramid, &memRequirements);
+
+		uint32_t memoryType = m_device->getMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		m_pyramidAllocation = m_device->getAllocator()->allocate(memRequirements, memoryType, AllocationKind::Optimal);
+
+		if (vkBindImageMemory(m_device->getDevice(), m_pyramid, m_pyramidAllocation.memory, m_pyramidAllocation.offset) != VK_SUCCESS) {
+			ELOG("Failed to bind image memory!");
+			throw std::runtime_error("Failed to bind image memory!");
+		}
+
+		VkImageViewCreateInfo viewInfo = {};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_pyramid;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = levels;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(m_device->getDevice(), &viewInfo, nullptr, &m_pyramidView) != VK_SUCCESS) {
+			ELOG("Failed to create image view!");
+			throw std::runtime_error("Failed to create image view!");
+		}
+
+		m_pyramidLevels.resize(levels);
+		for (uint32_t i = 0; i < levels; i++)
+		{
+			viewInfo.subresourceRange.baseMipLevel = i;
+			viewInfo.subresourceRange.levelCount = 1;
+
+			if (vkCreateImageView(m_device->getDevice(), &viewInfo, nullptr, &m_pyramidLevels[i]) != VK_SUCCESS) {
+				ELOG("Failed to create image view!");
+				throw std::runtime_error("Failed to create image view!");
+			}
+		}
+	}
+
+	void VulkanCulling::destroyPyramid()
+	{
+		VkDevice device = m_device->getDevice();
+
+		for (VkImageView view : m_pyramidLevels)
+		{
+			vkDestroyImageView(device, view, nullptr);
+		}
+		m_pyramidLevels.clear();
+		vkDestroyImageView(device, m_pyramidView, nullptr);
+		vkDestroyImage(device, m_pyramid, nullptr);
+		m_device->getAllocator()->free(m_pyramidAllocation);
+
+		m_pyramidView = VK_NULL_HANDLE;
+		m_pyramid = VK_NULL_HANDLE;
+	}
+
+	void VulkanCulling::createDescriptorSets(VkImageView depthView, VulkanPerFrameBuffer* objectBuffer, VulkanPerFrameBuffer* indirectBuffer, VulkanPerFrameBuffer* visibleBuffer)
+	{
+		uint32_t pyramidSetCount = static_cast<uint32_t>(m_pyramidLevels.size());
+
+		std::array<VkDescriptorPoolSize, 4> poolSizes = {};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		poolSizes[0].descriptorCount = m_frameCount;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[1].descriptorCount = m_frameCount * 5;
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[2].descriptorCount = m_frameCount + pyramidSetCount;
+		poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSizes[3].descriptorCount = pyramidSetCount;
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = m_frameCount + pyramidSetCount;
+
+		if (vkCreateDescriptorPool(m_device->getDevice(), &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS) {
+			ELOG("Failed to create descriptor pool!");
+			throw std::runtime_error("Failed to create descriptor pool!");
+		}
+
+		std::vector<VkDescriptorSetLayout> cullLayouts(m_frameCount, m_cullSetLayout);
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_descriptorPool;
+		allocInfo.descriptorSetCount = m_frameCount;
+		allocInfo.pSetLayouts = cullLayouts.data();
+
+		m_cullSets.resize(m_frameCount);
+		if (vkAllocateDescriptorSets(m_device->getDevice(), &allocInfo, m_cullSets.data()) != VK_SUCCESS) {
+			ELOG("Failed to allocate descriptor sets!");
+			throw std::runtime_error("Failed to allocate descriptor sets!");
+		}
+
+		std::vector<VkDescriptorSetLayout> pyramidLayouts(pyramidSetCount, m_pyramidSetLayout);
+		allocInfo.descriptorSetCount = pyramidSetCount;
+		allocInfo.pSetLayouts = pyramidLayouts.data();
+
+		m_pyramidSets.resize(pyramidSetCount);
+		if (vkAllocateDescriptorSets(m_device->getDevice(), &allocInfo, m_pyramidSets.data()) != VK_SUCCESS) {
+			ELOG("Failed to allocate descriptor sets!");
+			throw std::runtime_error("Failed to allocate descriptor sets!");
+		}
+
+		VkDescriptorImageInfo pyramidInfo = {};
+		pyramidInfo.sampler = m_sampler;
+		pyramidInfo.imageView = m_pyramidView;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		for (uint32_t i = 0; i < m_frameCount; i++)
+		{
+			std::array<VkDescriptorBufferInfo, 6> bufferInfos = {
+				m_paramsBuffer.getDescriptor(i),
+				objectBuffer->getDescriptor(i),
+				m_objectBatchBuffer.getDescriptor(i),
+				m_batchBuffer.getDescriptor(i),
+				indirectBuffer->getDescriptor(i),
+				visibleBuffer->getDescriptor(i)
+			};
+
+			std::array<VkWriteDescriptorSet, 7> writes = {};
+			for (uint32_t binding = 0; binding < writes.size(); binding++)
+			{
+				writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[binding].dstSet = m_cullSets[i];
+				writes[binding].dstBinding = binding;
+				writes[binding].descriptorCount = 1;
+
+				if (binding == 0)
+				{
+					writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+					writes[binding].pBufferInfo = &bufferInfos[binding];
+				}
+				else if (binding < 6)
+				{
+					writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					writes[binding].pBufferInfo = &bufferInfos[binding];
+				}
+				else
+				{
+					writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+					writes[binding].pImageInfo = &pyramidInfo;
+				}
+			}
+
+			vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+
+		for (uint32_t level = 0; level < pyramidSetCount; level++)
+		{
+			//Level 0 reads the depth buffer, which is sampled in the read only layout after the render pass
+			VkDescriptorImageInfo sourceInfo = {};
+			sourceInfo.sampler = m_sampler;
+			sourceInfo.imageView = level == 0 ? depthView : m_pyramidLevels[level - 1];
+			sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+			VkDescriptorImageInfo targetInfo = {};
+			targetInfo.imageView = m_pyramidLevels[level];
+			targetInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			std::array<VkWriteDescriptorSet, 2> writes = {};
+			writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[0].dstSet = m_pyramidSets[level];
+			writes[0].dstBinding = 0;
+			writes[0].descriptorCount = 1;
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[0].pImageInfo = &sourceInfo;
+
+			writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[1].dstSet = m_pyramidSets[level];
+			writes[1].dstBinding = 1;
+			writes[1].descriptorCount = 1;
+			writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[1].pImageInfo = &targetInfo;
+
+			vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+
+	void VulkanCulling::update(uint32_t frame, const glm::mat4& viewProj, uint32_t objectCount, uint32_t batchCount)
+	{
+		CullParams params = {};
+		params.prevViewProj = m_prevViewProj;
+
+		Frustum frustum = Frustum::fromMatrix(viewProj);
+		for (int i = 0; i < 6; i++)
+		{
+			params.planes[i] = frustum.planes[i];
+		}
+
+		params.pyramidSize = glm::vec2(m_pyramidExtent.width, m_pyramidExtent.height);
+		params.pyramidLevels = static_cast<float>(m_pyramidLevels.size());
+		params.objectCount = objectCount;
+
+		//The first frame has no depth to test against yet
+		params.occlusion = m_framesCulled > 0 ? 1 : 0;
+
+		m_paramsBuffer.write(frame, &params, sizeof(params));
+
+		VkDispatchIndirectCommand dispatch = {};
+		dispatch.x = (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+		dispatch.y = 1;
+		dispatch.z = 1;
+		m_dispatchBuffer.write(frame, &dispatch, sizeof(dispatch));
+
+		m_objectBatchBuffer.flush(frame, objectCount * sizeof(uint32_t));
+		m_batchBuffer.flush(frame, batchCount * sizeof(CullBatch));
+
+		m_prevViewProj = viewProj;
+		m_framesCulled++;
+	}
+
+	void VulkanCulling::cull(VkCommandBuffer commandBuffer, uint32_t frame)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullLayout, 0, 1, &m_cullSets[frame], 0, nullptr);
+		vkCmdDispatchIndirect(commandBuffer, m_dispatchBuffer.getBuffer(), m_dispatchBuffer.getFrameOffset(frame));
+	}
+
+	void VulkanCulling::buildDepthPyramid(VkCommandBuffer commandBuffer)
+	{
+		VkImageMemoryBarrier levelBarrier = {};
+		levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.image = m_pyramid;
+		levelBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		levelBarrier.subresourceRange.levelCount = 1;
+		levelBarrier.subresourceRange.layerCount = 1;
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		PyramidConstants constants = {};
+		constants.srcWidth = static_cast<int32_t>(m_pyramidExtent.width);
+		constants.srcHeight = static_cast<int32_t>(m_pyramidExtent.height);
+		constants.dstWidth = constants.srcWidth;
+		constants.dstHeight = constants.srcHeight;
+		constants.samples = static_cast<int32_t>(m_device->getMsaaSamples());
+
+		for (uint32_t level = 0; level < m_pyramidLevels.size(); level++)
+		{
+			if (level > 0)
+			{
+				constants.srcWidth = constants.dstWidth;
+				constants.srcHeight = constants.dstHeight;
+				constants.dstWidth = std::max(1, constants.dstWidth / 2);
+				constants.dstHeight = std::max(1, constants.dstHeight / 2);
+			}
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, level == 0 ? m_depthPipeline : m_reducePipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pyramidLayout, 0, 1, &m_pyramidSets[level], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, m_pyramidLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+			vkCmdDispatch(commandBuffer,
+				(constants.dstWidth + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+				(constants.dstHeight + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+				1);
+
+			//Each level is read by the next
+			levelBarrier.subresourceRange.baseMipLevel = level;
+			vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				1, &levelBarrier);
+		}
+	}
+}
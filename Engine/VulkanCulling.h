@@ -0,0 +1,126 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "VulkanAllocator.h"
+#include "VulkanPerFrameBuffer.h"
+
+namespace VEngine {
+
+	class VulkanDevice;
+
+	const static uint32_t CULL_GROUP_SIZE = 64;
+	const static uint32_t PYRAMID_GROUP_SIZE = 8;
+
+	//Local bounds of a batch's mesh and the indirect command its visible instances are counted into
+	struct CullBatch {
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+		uint32_t drawSlot;
+		uint32_t pad[3];
+	};
+
+	struct CullParams {
+		//Last frame's view projection, for testing against the depth pyramid it left behind
+		glm::mat4 prevViewProj;
+		glm::vec4 planes[6];
+		glm::vec2 pyramidSize;
+		float pyramidLevels;
+		uint32_t objectCount;
+		uint32_t occlusion;
+		uint32_t pad[3];
+	};
+
+	/*
+	 * GPU culling ahead of the main pass. A compute shader tests every object's bounds against the frustum and against a
+	 * depth pyramid built from the previous frame's depth buffer, then compacts the survivors: each visible object bumps
+	 * its batch's indirect instance count and writes its object index into the visible buffer, which the vertex shader
+	 * reads through gl_InstanceIndex.
+	 *
+	 * The renderer writes the objects and their batches, then adds cull() before its main pass and buildDepthPyramid()
+	 * after it to its render graph, which syncs them with the draws. Nothing here needs more than core Vulkan 1.0, so it
+	 * also runs on software drivers.
+	 */
+	class VulkanCulling
+	{
+	public:
+		//Returns false, leaving culling off, when the compute shaders haven't been built
+		bool create(VulkanDevice* device, uint32_t frameCount, VkExtent2D extent, VkImageView depthView, VkFormat depthFormat, VkSampleCountFlagBits depthSamples,
+			VulkanPerFrameBuffer* objectBuffer, VulkanPerFrameBuffer* indirectBuffer, VulkanPerFrameBuffer* visibleBuffer);
+		void destroy();
+		//Remakes the depth pyramid for a new depth buffer, keeping the pipelines and per frame buffers.
+		//Returns what frees the old pyramid and sets, to run once the frames culled with them are done.
+		std::function<void()> resize(VkExtent2D extent, VkImageView depthView);
+
+		bool isEnabled() { return m_enabled; };
+
+		//Per frame inputs, written by the renderer before update()
+		uint32_t* getObjectBatches(uint32_t frame) { return static_cast<uint32_t*>(m_objectBatchBuffer.getFrame(frame)); };
+		CullBatch* getBatches(uint32_t frame) { return static_cast<CullBatch*>(m_batchBuffer.getFrame(frame)); };
+
+		void update(uint32_t frame, const glm::mat4& viewProj, uint32_t objectCount, uint32_t batchCount);
+
+		void cull(VkCommandBuffer commandBuffer, uint32_t frame);
+		//Reads the depth buffer in the read only layout, the pyramid is kept in the general layout
+		void buildDepthPyramid(VkCommandBuffer commandBuffer);
+
+		VkImage getPyramid() { return m_pyramid; };
+		uint32_t getPyramidLevelCount() { return static_cast<uint32_t>(m_pyramidLevels.size()); };
+
+	private:
+		VkShaderModule loadShader(const std::string& filename);
+		VkPipeline createComputePipeline(VkShaderModule module, VkPipelineLayout layout);
+		VkDescriptorSetLayout createSetLayout(const std::vector<VkDescriptorType>& types);
+
+		void createPyramid(VkExtent2D extent);
+		void destroyPyramid();
+		void createDescriptorSets(VkImageView depthView, VulkanPerFrameBuffer* objectBuffer, VulkanPerFrameBuffer* indirectBuffer, VulkanPerFrameBuffer* visibleBuffer);
+
+		VulkanDevice* m_device = nullptr;
+		bool m_enabled = false;
+		uint32_t m_frameCount = 0;
+		VkFormat m_depthFormat = VK_FORMAT_UNDEFINED;
+
+		//Frames culled since creation, occlusion needs one frame's depth to test against
+		uint32_t m_framesCulled = 0;
+		glm::mat4 m_prevViewProj = glm::mat4(1.0f);
+
+		VulkanPerFrameBuffer m_paramsBuffer;
+		VulkanPerFrameBuffer m_objectBatchBuffer;
+		VulkanPerFrameBuffer m_batchBuffer;
+		VulkanPerFrameBuffer m_dispatchBuffer;
+
+		//The renderer's buffers the cull sets point at, for writing them again on resize
+		VulkanPerFrameBuffer* m_objectBuffer = nullptr;
+		VulkanPerFrameBuffer* m_indirectBuffer = nullptr;
+		VulkanPerFrameBuffer* m_visibleBuffer = nullptr;
+
+		VkImage m_pyramid = VK_NULL_HANDLE;
+		VulkanAllocation m_pyramidAllocation;
+		VkImageView m_pyramidView = VK_NULL_HANDLE;
+		std::vector<VkImageView> m_pyramidLevels;
+		VkExtent2D m_pyramidExtent = {};
+		VkSampler m_sampler = VK_NULL_HANDLE;
+
+		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+
+		VkDescriptorSetLayout m_cullSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout m_cullLayout = VK_NULL_HANDLE;
+		VkPipeline m_cullPipeline = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> m_cullSets;
+
+		//Depth pyramid, level 0 reduces the depth buffer's samples and every level after halves the one before
+		VkDescriptorSetLayout m_pyramidSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout m_pyramidLayout = VK_NULL_HANDLE;
+		VkPipeline m_depthPipeline = VK_NULL_HANDLE;
+		VkPipeline m_reducePipeline = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> m_pyramidSets;
+	};
+}
@@ -0,0 +1,34 @@
+#include "VulkanDeletionQueue.h"
+#include "VulkanStagingBuffer.h"
+
+namespace VEngine {
+
+	void VulkanDeletionQueue::push(uint64_t frame, std::function<void()> destroy, uint64_t uploadSerial)
+	{
+		m_deletions.push_back({ frame, uploadSerial, std::move(destroy) });
+	}
+
+	void VulkanDeletionQueue::flush(uint64_t completedFrame, const VulkanStagingBuffer* uploads)
+	{
+		while (!m_deletions.empty())
+		{
+			Deletion& deletion = m_deletions.front();
+
+			//Uploads land within a frame or two, holding the rest back that long keeps the queue in order
+			if (deletion.frame > completedFrame || !uploads->isComplete(deletion.uploadSerial))
+				return;
+
+			deletion.destroy();
+			m_deletions.pop_front();
+		}
+	}
+
+	void VulkanDeletionQueue::flushAll()
+	{
+		while (!m_deletions.empty())
+		{
+			m_deletions.front().destroy();
+			m_deletions.pop_front();
+		}
+	}
+}
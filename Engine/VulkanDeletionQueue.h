@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace VEngine {
+
+	class VulkanStagingBuffer;
+
+	/*
+	 * GPU resources whose last user is gone, waiting for the frames that may still read them to finish.
+	 * Each deletion is tagged with the frame being built when it was queued. The renderer flushes the queue
+	 * with the newest frame its fences show as finished, so destroying something never waits on the GPU.
+	 */
+	class VulkanDeletionQueue
+	{
+	public:
+		//uploadSerial holds the deletion back until a transfer into the resource has landed too
+		void push(uint64_t frame, std::function<void()> destroy, uint64_t uploadSerial = 0);
+
+		//Runs the deletions queued on or before completedFrame, uploads is checked for their transfers
+		void flush(uint64_t completedFrame, const VulkanStagingBuffer* uploads);
+
+		//Runs everything, for when the device is already idle
+		void flushAll();
+
+		size_t size() const { return m_deletions.size(); };
+
+	private:
+		struct Deletion
+		{
+			uint64_t frame;
+			uint64_t uploadSerial;
+			std::function<void()> destroy;
+		};
+
+		//In frame order, so flushing stops at the first entry still in use
+		std::deque<Deletion> m_deletions;
+	};
+}
@@ -0,0 +1,174 @@
+#include "VulkanDescriptors.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+#define LOGGING_LEVEL_1
+#include "Logger.h"
+#include "Metrics.h"
+
+namespace VEngine {
+
+	//Descriptors of each type per set in a pool, a rough guess at the mix the renderer's sets use
+	static const std::array<std::pair<VkDescriptorType, float>, 7> POOL_RATIOS = { {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0.5f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0.5f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+	} };
+
+	bool DescriptorLayoutCache::BindingKey::operator<(const BindingKey& other) const
+	{
+		if (binding != other.binding)
+			return binding < other.binding;
+		if (type != other.type)
+			return type < other.type;
+		if (count != other.count)
+			return count < other.count;
+		return stages < other.stages;
+	}
+
+	void DescriptorLayoutCache::create(VkDevice device)
+	{
+		m_device = device;
+	}
+
+	void DescriptorLayoutCache::destroy()
+	{
+		for (auto& layout : m_layouts)
+		{
+			vkDestroyDescriptorSetLayout(m_device, layout.second, nullptr);
+		}
+		m_layouts.clear();
+	}
+
+	VkDescriptorSetLayout DescriptorLayoutCache::getLayout(std::vector<VkDescriptorSetLayoutBinding> bindings)
+	{
+		std::sort(bindings.begin(), bindings.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+			return a.binding < b.binding;
+		});
+
+		std::vector<BindingKey> key;
+		key.reserve(bindings.size());
+		for (const VkDescriptorSetLayoutBinding& binding : bindings)
+		{
+			key.push_back({ binding.binding, binding.descriptorType, binding.descriptorCount, binding.stageFlags });
+		}
+
+		auto found = m_layouts.find(key);
+		if (found != m_layouts.end())
+			return found->second;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		VkDescriptorSetLayout layout;
+		if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+			ELOG("Failed to create descriptor set layout!");
+			throw std::runtime_error("Failed to create descriptor set layout!");
+		}
+
+		m_layouts.insert({ std::move(key), layout });
+		return layout;
+	}
+
+	void DescriptorAllocator::create(VkDevice device, uint32_t setsPerPool)
+	{
+		m_device = device;
+		m_setsPerPool = setsPerPool;
+	}
+
+	void DescriptorAllocator::destroy()
+	{
+		for (VkDescriptorPool pool : m_usedPools)
+		{
+			vkDestroyDescriptorPool(m_device, pool, nullptr);
+		}
+		for (VkDescriptorPool pool : m_freePools)
+		{
+			vkDestroyDescriptorPool(m_device, pool, nullptr);
+		}
+
+		m_usedPools.clear();
+		m_freePools.clear();
+		m_currentPool = VK_NULL_HANDLE;
+	}
+
+	VkDescriptorPool DescriptorAllocator::grabPool()
+	{
+		if (!m_freePools.empty())
+		{
+			VkDescriptorPool pool = m_freePools.back();
+			m_freePools.pop_back();
+			return pool;
+		}
+
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (auto& ratio : POOL_RATIOS)
+		{
+			poolSizes.push_back({ ratio.first, std::max(1u, static_cast<uint32_t>(ratio.second * m_setsPerPool)) });
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = m_setsPerPool;
+
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+			ELOG("Failed to create descriptor pool!");
+			throw std::runtime_error("Failed to create descriptor pool!");
+		}
+
+		static Gauge* pools = Metrics::get().gauge("vengine_descriptor_pools", "Descriptor pools created by the descriptor allocators");
+		pools->add();
+
+		return pool;
+	}
+
+	bool DescriptorAllocator::allocate(VkDescriptorSetLayout layout, VkDescriptorSet* set)
+	{
+		if (m_currentPool == VK_NULL_HANDLE)
+		{
+			m_currentPool = grabPool();
+			m_usedPools.push_back(m_currentPool);
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_currentPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		if (vkAllocateDescriptorSets(m_device, &allocInfo, set) == VK_SUCCESS)
+			return true;
+
+		//A spent pool reports VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL, drivers without
+		//maintenance1 may report running out of memory instead, so any failure gets one retry in a fresh pool
+		m_currentPool = grabPool();
+		m_usedPools.push_back(m_currentPool);
+
+		allocInfo.descriptorPool = m_currentPool;
+		return vkAllocateDescriptorSets(m_device, &allocInfo, set) == VK_SUCCESS;
+	}
+
+	void DescriptorAllocator::reset()
+	{
+		for (VkDescriptorPool pool : m_usedPools)
+		{
+			vkResetDescriptorPool(m_device, pool, 0);
+			m_freePools.push_back(pool);
+		}
+
+		m_usedPools.clear();
+		m_currentPool = VK_NULL_HANDLE;
+	}
+}
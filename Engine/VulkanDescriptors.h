@@ -0,0 +1,67 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace VEngine {
+
+	//Sets each pool of a DescriptorAllocator holds, its descriptor counts are scaled from this
+	const static uint32_t DESCRIPTOR_SETS_PER_POOL = 64;
+
+	/*
+	 * One VkDescriptorSetLayout for every distinct set of bindings, so materials, passes and the renderer asking for the
+	 * same bindings share a layout, and with it pipeline layout compatibility. Layouts live until destroy().
+	 */
+	class DescriptorLayoutCache
+	{
+	public:
+		void create(VkDevice device);
+		void destroy();
+
+		//Bindings may come in any order, immutable samplers aren't supported
+		VkDescriptorSetLayout getLayout(std::vector<VkDescriptorSetLayoutBinding> bindings);
+
+	private:
+		struct BindingKey
+		{
+			uint32_t binding;
+			VkDescriptorType type;
+			uint32_t count;
+			VkShaderStageFlags stages;
+
+			bool operator<(const BindingKey& other) const;
+		};
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		std::map<std::vector<BindingKey>, VkDescriptorSetLayout> m_layouts;
+	};
+
+	/*
+	 * Hands out descriptor sets from a list of pools, starting another pool whenever the current one runs dry instead of
+	 * failing. Pools are never freed one set at a time: reset() returns every set at once and keeps the pools for reuse,
+	 * so an allocator owned by a frame in flight can be reset when its fence has passed and serve that frame's transient sets.
+	 */
+	class DescriptorAllocator
+	{
+	public:
+		void create(VkDevice device, uint32_t setsPerPool = DESCRIPTOR_SETS_PER_POOL);
+		void destroy();
+
+		//Returns false only when a brand new pool can't fit the set either
+		bool allocate(VkDescriptorSetLayout layout, VkDescriptorSet* set);
+		void reset();
+
+		size_t getPoolCount() { return m_usedPools.size() + m_freePools.size(); };
+
+	private:
+		VkDescriptorPool grabPool();
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		uint32_t m_setsPerPool = DESCRIPTOR_SETS_PER_POOL;
+
+		VkDescriptorPool m_currentPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorPool> m_usedPools;
+		std::vector<VkDescriptorPool> m_freePools;
+	};
+}
@@ -1,15 +1,67 @@
 #include "VulkanDevice.h"
 #include "VulkanSwapChain.h"
+#include <algorithm>
 #include <set>
+#include <string>
 namespace VEngine {
 
-	void VulkanDevice::createDevice(VkInstance instance, VkSurfaceKHR* surface)
+	void VulkanDevice::createDevice(VkInstance instance, VkSurfaceKHR* surface, bool physicalDeviceProperties2)
 	{
 		m_surface = surface;
+		m_headless = surface == nullptr || *surface == VK_NULL_HANDLE;
 		pickPhysicalDevice(instance);
+		m_descriptorIndexing = physicalDeviceProperties2 && queryDescriptorIndexing(instance);
 		createLogicalDevice();
 	}
 
+	bool VulkanDevice::queryDescriptorIndexing(VkInstance instance)
+	{
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+		std::set<std::string> requiredExtensions(descriptorIndexingExtensions.begin(), descriptorIndexingExtensions.end());
+		for (const auto& extension : availableExtensions) {
+			requiredExtensions.erase(extension.extensionName);
+		}
+
+		if (!requiredExtensions.empty())
+			return false;
+
+		//Core in 1.1, the instance is 1.0 so they come from the extension
+		auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+		auto getProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR");
+		if (!getFeatures2 || !getProperties2)
+			return false;
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2KHR features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		features.pNext = &indexingFeatures;
+		getFeatures2(m_physicalDevice, &features);
+
+		if (!indexingFeatures.shaderSampledImageArrayNonUniformIndexing || !indexingFeatures.runtimeDescriptorArray
+			|| !indexingFeatures.descriptorBindingPartiallyBound || !indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+			|| !indexingFeatures.descriptorBindingSampledImageUpdateAfterBind || !indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind)
+			return false;
+
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+		indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2KHR properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+		properties.pNext = &indexingProperties;
+		getProperties2(m_physicalDevice, &properties);
+
+		m_maxBindlessTextures = std::min(indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages);
+		m_maxBindlessBuffers = std::min(indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers, indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers);
+		return true;
+	}
+
 	void VulkanDevice::pickPhysicalDevice(VkInstance instance) {
 		uint32_t deviceCount = 0;
 		vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
@@ -140,7 +192,9 @@ namespace VEngine {
 		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-		std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+		std::set<std::string> requiredExtensions;
+		if (!m_headless)
+			requiredExtensions.insert(deviceExtensions.begin(), deviceExtensions.end());
 
 		for (const auto& extension : availableExtensions) {
 			requiredExtensions.erase(extension.extensionName);
@@ -155,8 +209,8 @@ namespace VEngine {
 
 		bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-		bool swapChainAdequate = false;
-		if (extensionsSupported) {
+		bool swapChainAdequate = m_headless;
+		if (extensionsSupported && !m_headless) {
 			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 		}
@@ -197,7 +251,12 @@ namespace VEngine {
 		vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);
 
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		//Indirect commands start each batch at its first object, without it batches are drawn directly
+		deviceFeatures.drawIndirectFirstInstance = m_features.drawIndirectFirstInstance;
 		//deviceFeatures.sampleRateShading = VK_TRUE;
+		//For the GPU profiler, it's left out of the results where missing
+		deviceFeatures.pipelineStatisticsQuery = m_features.pipelineStatisticsQuery;
+		deviceFeatures.multiDrawIndirect = m_features.multiDrawIndirect;
 
 		QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
 
@@ -214,13 +273,32 @@ namespace VEngine {
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		//Headless devices render offscreen only, there's no surface to make a swapchain for
+		std::vector<const char*> extensions;
+		if (!m_headless)
+			extensions = deviceExtensions;
+
+		//Only what the bindless set uses, the rest of descriptor indexing stays off
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		if (m_descriptorIndexing) {
+			extensions.insert(extensions.end(), descriptorIndexingExtensions.begin(), descriptorIndexingExtensions.end());
+			indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+			indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+			indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		}
+
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = m_descriptorIndexing ? &indexingFeatures : nullptr;
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pEnabledFeatures = &deviceFeatures;
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		createInfo.ppEnabledExtensionNames = extensions.data();
 
 		if (enableValidationLayers) {
 			createInfo.enabledLayerCount = static_cast<uint32_t>(Debug::validationLayers.size());
@@ -236,66 +314,48 @@ namespace VEngine {
 		}
 
 		vkGetDeviceQueue(m_logicalDevice, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
+		m_graphicsFamilyIndex = indices.graphicsFamily.value();
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
+		m_timestampValidBits = queueFamilies[m_graphicsFamilyIndex].timestampValidBits;
 		vkGetDeviceQueue(m_logicalDevice, indices.presentFamily.value(), 0, &m_presentQueue);
 		vkGetDeviceQueue(m_logicalDevice, indices.transferFamily.value(), 0, &m_transferQueue);
 
+		m_allocator.init(m_logicalDevice, m_memoryProperties, m_properties.limits);
+		m_pipelineCache.create(m_logicalDevice, m_properties);
+		m_layoutCache.create(m_logicalDevice);
+
 		m_graphicsCommandPool = createCommandPool(indices.graphicsFamily.value());
 		m_transferCommandPool = createCommandPool(indices.transferFamily.value());
-	}
 
-	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory, void* data)
-	{
-		// Create the buffer handle
-		VkBufferCreateInfo bufferCreateInfo{};
-		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCreateInfo.usage = usageFlags;
-		bufferCreateInfo.size = size;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		if (vkCreateBuffer(m_logicalDevice, &bufferCreateInfo, nullptr, buffer) != VK_SUCCESS) {
-			ELOG("Failed to create buffer!");
-			throw std::runtime_error("Failed to create buffer!");
-		}
+		//Uploads are batched and submitted on the graphics queue ahead of each frame
+		m_staging.create(this, m_graphicsQueue, indices.graphicsFamily.value());
 
-		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = {};
-		memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		vkGetBufferMemoryRequirements(m_logicalDevice, *buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		if (vkAllocateMemory(m_logicalDevice, &memAlloc, nullptr, memory) != VK_SUCCESS) {
-			ELOG("Failed to allocate memory for buffer!");
-			throw std::runtime_error("Failed to allocate memory for buffer!");
-		}
+		//Buffer uploads go through the transfer queue when there is one, released to the graphics family
+		m_transferStaging.create(this, m_transferQueue, indices.transferFamily.value(), DEFAULT_STAGING_BUFFER_SIZE, &m_staging);
 
-		if (data != nullptr)
-		{
-			void* mapped;
-			if (vkMapMemory(m_logicalDevice, *memory, 0, size, 0, &mapped) != VK_SUCCESS) {
-				ELOG("Failed to map buffer!");
-				throw std::runtime_error("Failed to map buffer!");
-			}
-			memcpy(mapped, data, (size_t)size);
+		m_geometryPool.create(this);
+	}
 
-			// If host coherency hasn't been requested, do a manual flush to make writes visible
-			if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
-			{
-				VkMappedMemoryRange mappedRange = {};
-				mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-				mappedRange.memory = *memory;
-				mappedRange.offset = 0;
-				mappedRange.size = size;
-				vkFlushMappedMemoryRanges(m_logicalDevice, 1, &mappedRange);
-			}
-			vkUnmapMemory(m_logicalDevice, *memory);
-		}
+	void VulkanDevice::reclaimUploads()
+	{
+		m_transferStaging.reclaim();
+		m_staging.reclaim();
+	}
 
-		// Bind the memory to the buffer object
-		if (vkBindBufferMemory(m_logicalDevice, *buffer, *memory, 0) != VK_SUCCESS) {
-			ELOG("Failed to bind buffer!");
-			throw std::runtime_error("Failed to bind buffer!");
-		}
+	void VulkanDevice::submitUploads()
+	{
+		m_transferStaging.submit();
+		m_staging.submit();
+	}
 
-		return VK_SUCCESS;
+	void VulkanDevice::flushUploads()
+	{
+		m_transferStaging.flush();
+		m_staging.flush();
 	}
 
 	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VulkanBuffer* buffer, VkDeviceSize size, void* data)
@@ -313,25 +373,21 @@ namespace VEngine {
 		}
 
 		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = {};
-		memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 		vkGetBufferMemoryRequirements(m_logicalDevice, buffer->getBuffer(), &memReqs);
-		memAlloc.allocationSize = memReqs.size;
 
-		memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		if (vkAllocateMemory(m_logicalDevice, &memAlloc, nullptr, &buffer->getMemory()) != VK_SUCCESS) {
-			ELOG("Failed to allocate memory for buffer!");
-			throw std::runtime_error("Failed to allocate memory for buffer!");
-		}
+		uint32_t memoryType = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
+		buffer->setAllocation(&m_allocator, m_allocator.allocate(memReqs, memoryType, AllocationKind::Linear));
 
 		buffer->getAlignment() = memReqs.alignment;
-		buffer->getSize() = memAlloc.allocationSize;
+		buffer->getSize() = memReqs.size;
 		buffer->getUsageFlags() = usageFlags;
 		buffer->getMemoryPropertyFlags() = memoryPropertyFlags;
 
 		// If a pointer to the buffer data has been passed, map the buffer and copy over the data
 		if (data != nullptr)
 		{
+			recordUpload(size);
+
 			if (buffer->map() != VK_SUCCESS) {
 				ELOG("Failed to map buffer!");
 				throw std::runtime_error("Failed to map buffer!");
@@ -398,6 +454,12 @@ namespace VEngine {
 		}
 	}
 
+	void VulkanDevice::recordUpload(VkDeviceSize size)
+	{
+		static Counter* uploadedBytes = Metrics::get().counter("vengine_gpu_uploaded_bytes_total", "Bytes copied from the host into buffers at creation");
+		uploadedBytes->add(static_cast<int64_t>(size));
+	}
+
 	QueueFamilyIndices VulkanDevice::findQueueFamilies(VkPhysicalDevice device) {
 		QueueFamilyIndices indices;
 
@@ -422,8 +484,12 @@ namespace VEngine {
 				}
 			}			
 			
+			//Nothing is presented headless, the graphics family stands in
 			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, *m_surface, &presentSupport);
+			if (m_headless)
+				presentSupport = indices.graphicsFamily.has_value() && indices.graphicsFamily.value() == static_cast<uint32_t>(i);
+			else
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, *m_surface, &presentSupport);
 
 			if (queueFamily.queueCount > 0 && presentSupport) {
 				indices.presentFamily = i;
@@ -531,6 +597,16 @@ namespace VEngine {
 
 	void VulkanDevice::destroy()
 	{
+		flushUploads();
+		m_transferStaging.destroy();
+		m_staging.destroy();
+		m_geometryPool.destroy();
+
+		m_allocator.logStats();
+		m_allocator.destroy();
+		m_pipelineCache.destroy();
+		m_layoutCache.destroy();
+
 		vkDestroyCommandPool(m_logicalDevice, m_graphicsCommandPool, nullptr);
 		vkDestroyCommandPool(m_logicalDevice, m_transferCommandPool, nullptr);
 		m_physicalDevice = nullptr;
@@ -9,6 +9,12 @@
 
 #include "VulkanDebug.h"
 #include "VulkanBuffer.h"
+#include "VulkanAllocator.h"
+#include "VulkanStagingBuffer.h"
+#include "VulkanGeometryPool.h"
+#include "VulkanPipelineCache.h"
+#include "VulkanDescriptors.h"
+#include "Metrics.h"
 
 #define LOGGING_LEVEL_1
 #include "Logger.h"
@@ -41,13 +47,22 @@ namespace VEngine{
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 
+	//Enabled on top of deviceExtensions when the device has them, for bindless descriptors
+	const std::vector<const char*> descriptorIndexingExtensions = {
+		VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+		VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+	};
+
 	class VulkanDevice
 	{
 	public:
 
 		VkPhysicalDeviceFeatures deviceFeatures = {};
 
-		void createDevice(VkInstance instance, VkSurfaceKHR* surface);
+		//physicalDeviceProperties2 when the instance was made with VK_KHR_get_physical_device_properties2, needed to look for descriptor indexing.
+		//A null surface makes a headless device, without the swapchain extension and presenting nothing
+		void createDevice(VkInstance instance, VkSurfaceKHR* surface, bool physicalDeviceProperties2 = false);
+		bool isHeadless() { return m_headless; };
 
 		void pickPhysicalDevice(VkInstance instance);
 		bool isDeviceSuitable(VkPhysicalDevice device);
@@ -56,6 +71,7 @@ namespace VEngine{
 		SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
 		void createLogicalDevice();
+		bool queryDescriptorIndexing(VkInstance instance);
 	
 		VkCommandPool createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 		VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, bool begin = false, VkCommandBufferUsageFlags flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, VkCommandPool cmdPool = NULL);
@@ -66,7 +82,6 @@ namespace VEngine{
 		void destroy();
 
 		VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VulkanBuffer* buffer, VkDeviceSize size, void* data = nullptr);
-		VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory, void* data = nullptr);
 		void copyBuffer(VulkanBuffer* src, VulkanBuffer* dst, VkQueue queue, VkBufferCopy* copyRegion = nullptr);
 
 		VkCommandBuffer beginSingleTimeCommands(VkCommandPool cmdPool = NULL);
@@ -88,6 +103,9 @@ namespace VEngine{
 
 		uint32_t getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, VkBool32* memTypeFound = nullptr);
 
+		//Metrics for bytes copied into buffers from the host, allocations are counted by VulkanAllocator
+		void recordUpload(VkDeviceSize size);
+
 		VkSampleCountFlagBits getMaxUsableSampleCount();
 		
 
@@ -97,6 +115,7 @@ namespace VEngine{
 		VkQueue getGraphicsQueue() { return m_graphicsQueue; };
 		VkQueue getPresentQueue() { return m_presentQueue; };
 		VkQueue getTransferQueue() { return m_transferQueue; };
+		uint32_t getGraphicsQueueFamilyIndex() { return m_graphicsFamilyIndex; };
 
 		VkCommandPool getGraphicsCommandPool() { return m_graphicsCommandPool; };
 		VkCommandPool getTransferCommandPool() { return m_transferCommandPool; };
@@ -105,6 +124,37 @@ namespace VEngine{
 			return m_msaaSamples;
 		}
 
+		VulkanAllocator* getAllocator() { return &m_allocator; };
+		VulkanStagingBuffer* getStagingBuffer() { return &m_staging; };
+		VulkanStagingBuffer* getTransferStagingBuffer() { return &m_transferStaging; };
+		//Vertex and index buffers shared by every static mesh
+		VulkanGeometryPool* getGeometryPool() { return &m_geometryPool; };
+
+		//Every pipeline is created through this, it is loaded from and saved to disk with the device
+		VkPipelineCache getPipelineCache() { return m_pipelineCache.getCache(); };
+		//Descriptor set layouts shared by everything asking for the same bindings
+		DescriptorLayoutCache* getLayoutCache() { return &m_layoutCache; };
+
+		//Drive both upload rings, transfer first so its ownership releases are acquired on the graphics queue
+		void reclaimUploads();
+		void submitUploads();
+		void flushUploads();
+
+		const VkPhysicalDeviceProperties& getProperties() { return m_properties; };
+		//Lets indirect commands start at a non zero firstInstance, without it they have to be drawn directly
+		bool supportsDrawIndirectFirstInstance() { return deviceFeatures.drawIndirectFirstInstance == VK_TRUE; };
+
+		//VK_EXT_descriptor_indexing with non uniform indexing, partially bound arrays and updates after bind
+		bool supportsDescriptorIndexing() { return m_descriptorIndexing; };
+		uint32_t getMaxBindlessTextures() { return m_maxBindlessTextures; };
+		uint32_t getMaxBindlessBuffers() { return m_maxBindlessBuffers; };
+
+		//Bits of a timestamp written on the graphics queue that count, 0 when it can't write timestamps
+		uint32_t getTimestampValidBits() { return m_timestampValidBits; };
+		bool supportsPipelineStatistics() { return deviceFeatures.pipelineStatisticsQuery == VK_TRUE; };
+		//Lets one indirect draw call run several consecutive commands
+		bool supportsMultiDrawIndirect() { return deviceFeatures.multiDrawIndirect == VK_TRUE; };
+
 
 
 	private:
@@ -119,6 +169,7 @@ namespace VEngine{
 		VkQueue m_graphicsQueue;
 		VkQueue m_presentQueue;
 		VkQueue m_transferQueue;
+		uint32_t m_graphicsFamilyIndex = 0;
 
 		VkPhysicalDeviceProperties m_properties;
 		VkPhysicalDeviceFeatures m_features;
@@ -126,6 +177,18 @@ namespace VEngine{
 
 		VkSampleCountFlagBits m_msaaSamples;
 
+		bool m_headless = false;
+		bool m_descriptorIndexing = false;
+		uint32_t m_maxBindlessTextures = 0;
+		uint32_t m_maxBindlessBuffers = 0;
+		uint32_t m_timestampValidBits = 0;
+
+		VulkanAllocator m_allocator;
+		VulkanStagingBuffer m_staging;
+		VulkanStagingBuffer m_transferStaging;
+		VulkanGeometryPool m_geometryPool;
+		VulkanPipelineCache m_pipelineCache;
+		DescriptorLayoutCache m_layoutCache;
 	};
 
 }
@@ -0,0 +1,193 @@
+#include "VulkanGeometryPool.h"
+#include "VulkanDevice.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "Metrics.h"
+
+namespace VEngine {
+
+	void VulkanGeometryPool::create(VulkanDevice* device)
+	{
+		m_device = device;
+		m_reservedBytes = 0;
+		m_usedBytes = 0;
+
+		//The first block is made up front, most scenes never need a second
+		createBlock(GEOMETRY_VERTEX_BLOCK_SIZE, GEOMETRY_INDEX_BLOCK_SIZE);
+	}
+
+	void VulkanGeometryPool::destroy()
+	{
+		for (auto& block : m_blocks)
+		{
+			block->vertices.destroy();
+			block->indices.destroy();
+		}
+
+		m_blocks.clear();
+		m_reservedBytes = 0;
+		m_usedBytes = 0;
+		updateMetrics();
+	}
+
+	VulkanGeometryPool::Block* VulkanGeometryPool::createBlock(VkDeviceSize vertexSize, VkDeviceSize indexSize)
+	{
+		std::unique_ptr<Block> block(new Block());
+
+		if (m_device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &block->vertices, vertexSize) != VK_SUCCESS) {
+			ELOG("Failed to create geometry pool vertex buffer!");
+			throw std::runtime_error("Failed to create geometry pool vertex buffer!");
+		}
+
+		if (m_device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &block->indices, indexSize) != VK_SUCCESS) {
+			ELOG("Failed to create geometry pool index buffer!");
+			throw std::runtime_error("Failed to create geometry pool index buffer!");
+		}
+
+		block->freeVertices[0] = vertexSize;
+		block->freeIndices[0] = indexSize;
+
+		m_reservedBytes += vertexSize + indexSize;
+		m_blocks.push_back(std::move(block));
+		updateMetrics();
+
+		return m_blocks.back().get();
+	}
+
+	bool VulkanGeometryPool::allocateRange(FreeList& list, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		for (auto it = list.begin(); it != list.end(); ++it)
+		{
+			//Strides needn't be powers of two, so round up by division
+			VkDeviceSize aligned = (it->first + alignment - 1) / alignment * alignment;
+			VkDeviceSize end = it->first + it->second;
+			if (aligned + size > end)
+				continue;
+
+			VkDeviceSize start = it->first;
+			list.erase(it);
+
+			//Whatever's left either side of the allocation stays free
+			if (aligned > start)
+				list[start] = aligned - start;
+			if (aligned + size < end)
+				list[aligned + size] = end - (aligned + size);
+
+			offset = aligned;
+			return true;
+		}
+
+		return false;
+	}
+
+	void VulkanGeometryPool::releaseRange(FreeList& list, VkDeviceSize offset, VkDeviceSize size)
+	{
+		auto next = list.lower_bound(offset);
+
+		//Merge into the range ending where this one starts
+		if (next != list.begin())
+		{
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset)
+			{
+				offset = previous->first;
+				size += previous->second;
+				list.erase(previous);
+			}
+		}
+
+		//And swallow the range starting where it ends
+		if (next != list.end() && offset + size == next->first)
+		{
+			size += next->second;
+			list.erase(next);
+		}
+
+		list[offset] = size;
+	}
+
+	GeometryAllocation VulkanGeometryPool::upload(const void* vertices, VkDeviceSize vertexSize, uint32_t vertexStride, const uint32_t* indices, VkDeviceSize indexSize)
+	{
+		GeometryAllocation allocation;
+		allocation.vertexSize = vertexSize;
+		allocation.indexSize = indexSize;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			for (uint32_t i = 0; i < m_blocks.size() && !allocation.isValid(); i++)
+			{
+				Block& block = *m_blocks[i];
+				if (!allocateRange(block.freeVertices, vertexSize, vertexStride, allocation.vertexOffset))
+					continue;
+
+				if (!allocateRange(block.freeIndices, indexSize, sizeof(uint32_t), allocation.indexOffset))
+				{
+					releaseRange(block.freeVertices, allocation.vertexOffset, vertexSize);
+					continue;
+				}
+
+				allocation.block = i;
+			}
+
+			if (!allocation.isValid())
+			{
+				createBlock(std::max(GEOMETRY_VERTEX_BLOCK_SIZE, vertexSize), std::max(GEOMETRY_INDEX_BLOCK_SIZE, indexSize));
+
+				Block& block = *m_blocks.back();
+				allocateRange(block.freeVertices, vertexSize, vertexStride, allocation.vertexOffset);
+				allocateRange(block.freeIndices, indexSize, sizeof(uint32_t), allocation.indexOffset);
+				allocation.block = static_cast<uint32_t>(m_blocks.size() - 1);
+			}
+
+			m_usedBytes += vertexSize + indexSize;
+			updateMetrics();
+		}
+
+		allocation.firstVertex = static_cast<int32_t>(allocation.vertexOffset / vertexStride);
+		allocation.firstIndex = static_cast<uint32_t>(allocation.indexOffset / sizeof(uint32_t));
+
+		VulkanStagingBuffer* staging = m_device->getTransferStagingBuffer();
+		staging->uploadBuffer(vertices, vertexSize, getVertexBuffer(allocation.block), allocation.vertexOffset);
+		staging->uploadBuffer(indices, indexSize, getIndexBuffer(allocation.block), allocation.indexOffset);
+
+		return allocation;
+	}
+
+	void VulkanGeometryPool::free(GeometryAllocation& allocation)
+	{
+		if (!allocation.isValid())
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		Block& block = *m_blocks[allocation.block];
+		releaseRange(block.freeVertices, allocation.vertexOffset, allocation.vertexSize);
+		releaseRange(block.freeIndices, allocation.indexOffset, allocation.indexSize);
+
+		m_usedBytes -= allocation.vertexSize + allocation.indexSize;
+		updateMetrics();
+
+		allocation = GeometryAllocation();
+	}
+
+	void VulkanGeometryPool::bind(VkCommandBuffer commandBuffer, uint32_t block)
+	{
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1, &m_blocks[block]->vertices.getBuffer(), offsets);
+		vkCmdBindIndexBuffer(commandBuffer, m_blocks[block]->indices.getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	}
+
+	void VulkanGeometryPool::updateMetrics()
+	{
+		static Gauge* reserved = Metrics::get().gauge("vengine_geometry_pool_reserved_bytes", "Vertex and index buffer bytes the geometry pool has created");
+		static Gauge* used = Metrics::get().gauge("vengine_geometry_pool_used_bytes", "Vertex and index bytes of the meshes in the geometry pool");
+		static Gauge* blocks = Metrics::get().gauge("vengine_geometry_pool_blocks", "Vertex and index buffer pairs in the geometry pool");
+
+		reserved->set(static_cast<int64_t>(m_reservedBytes));
+		used->set(static_cast<int64_t>(m_usedBytes));
+		blocks->set(static_cast<int64_t>(m_blocks.size()));
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "VulkanBuffer.h"
+
+#define VERTEX_BUFFER_BIND_ID 0
+
+namespace VEngine {
+
+	class VulkanDevice;
+
+	const static VkDeviceSize GEOMETRY_VERTEX_BLOCK_SIZE = 64ull * 1024 * 1024;
+	const static VkDeviceSize GEOMETRY_INDEX_BLOCK_SIZE = 32ull * 1024 * 1024;
+
+	//Where a mesh lives in the pool, firstVertex and firstIndex go straight into its draws
+	struct GeometryAllocation
+	{
+		uint32_t block = UINT32_MAX;
+		VkDeviceSize vertexOffset = 0;
+		VkDeviceSize vertexSize = 0;
+		VkDeviceSize indexOffset = 0;
+		VkDeviceSize indexSize = 0;
+
+		int32_t firstVertex = 0;
+		uint32_t firstIndex = 0;
+
+		bool isValid() const { return block != UINT32_MAX; };
+	};
+
+	/*
+	 * Every static mesh's vertices and indices, packed into a few large vertex and index buffers instead of a pair of
+	 * buffers each. Meshes are sub-allocated first fit, vertices aligned to their own stride so the offset is a whole
+	 * vertexOffset, and a mesh's vertices and indices always share a block. Draws of meshes in the same block need the
+	 * buffers bound once, and their indirect commands differ only in the offsets.
+	 *
+	 * A block is added when no existing one has room, sized up for meshes bigger than the default. Freed ranges merge
+	 * with their neighbours, and must only be freed once no frame in flight still draws from them.
+	 */
+	class VulkanGeometryPool
+	{
+	public:
+		void create(VulkanDevice* device);
+		void destroy();
+
+		//Reserves room for the mesh and queues its copy on the transfer ring, complete with the ring's current upload serial
+		GeometryAllocation upload(const void* vertices, VkDeviceSize vertexSize, uint32_t vertexStride, const uint32_t* indices, VkDeviceSize indexSize);
+		void free(GeometryAllocation& allocation);
+
+		VkBuffer getVertexBuffer(uint32_t block) { return m_blocks[block]->vertices.getBuffer(); };
+		VkBuffer getIndexBuffer(uint32_t block) { return m_blocks[block]->indices.getBuffer(); };
+		uint32_t getBlockCount() { return static_cast<uint32_t>(m_blocks.size()); };
+
+		//Binds a block's vertex and index buffers for the draws after it
+		void bind(VkCommandBuffer commandBuffer, uint32_t block);
+
+	private:
+		//Free ranges by offset, merged with their neighbours as they're released
+		typedef std::map<VkDeviceSize, VkDeviceSize> FreeList;
+
+		struct Block
+		{
+			VulkanBuffer vertices;
+			VulkanBuffer indices;
+			FreeList freeVertices;
+			FreeList freeIndices;
+		};
+
+		Block* createBlock(VkDeviceSize vertexSize, VkDeviceSize indexSize);
+
+		static bool allocateRange(FreeList& list, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		static void releaseRange(FreeList& list, VkDeviceSize offset, VkDeviceSize size);
+
+		void updateMetrics();
+
+		VulkanDevice* m_device = nullptr;
+		std::vector<std::unique_ptr<Block>> m_blocks;
+		VkDeviceSize m_reservedBytes = 0;
+		VkDeviceSize m_usedBytes = 0;
+
+		std::mutex m_mutex;
+	};
+}
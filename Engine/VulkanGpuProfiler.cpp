@@ -0,0 +1,234 @@
+#include "VulkanGpuProfiler.h"
+#include "VulkanDevice.h"
+
+#include <algorithm>
+#include <array>
+
+#include "Metrics.h"
+
+namespace VEngine {
+
+	//In bit order, which is the order vkGetQueryPoolResults writes them in
+	static const VkQueryPipelineStatisticFlags STATISTICS =
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+	static const std::array<const char*, 5> STATISTIC_NAMES = {
+		"vengine_gpu_pass_input_primitives",
+		"vengine_gpu_pass_vertex_invocations",
+		"vengine_gpu_pass_clipping_primitives",
+		"vengine_gpu_pass_fragment_invocations",
+		"vengine_gpu_pass_compute_invocations"
+	};
+
+	static const std::vector<double> GPU_TIME_BOUNDS = { 0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.7, 33.3 };
+
+	void VulkanGpuProfiler::create(VulkanDevice* device, uint32_t frameCount)
+	{
+		m_device = device;
+		m_frameCount = frameCount;
+		m_enabled = false;
+
+		uint32_t validBits = device->getTimestampValidBits();
+		if (validBits == 0 || device->getProperties().limits.timestampPeriod <= 0.0f) {
+			WLOG("Graphics queue can't write timestamps, GPU profiling disabled!");
+			return;
+		}
+
+		m_timestampPeriod = device->getProperties().limits.timestampPeriod;
+		m_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		m_statistics = device->supportsPipelineStatistics();
+
+		m_frames.reset(new FrameQueries[frameCount]);
+		for (uint32_t i = 0; i < frameCount; i++)
+		{
+			FrameQueries& queries = m_frames[i];
+			queries.scopes.resize(MAX_GPU_SCOPES);
+
+			VkQueryPoolCreateInfo poolInfo = {};
+			poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			poolInfo.queryCount = MAX_GPU_SCOPES * 2;
+
+			if (vkCreateQueryPool(device->getDevice(), &poolInfo, nullptr, &queries.timestamps) != VK_SUCCESS) {
+				ELOG("Failed to create query pool!");
+				throw std::runtime_error("Failed to create query pool!");
+			}
+
+			if (!m_statistics)
+				continue;
+
+			poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			poolInfo.queryCount = MAX_GPU_SCOPES;
+			poolInfo.pipelineStatistics = STATISTICS;
+
+			if (vkCreateQueryPool(device->getDevice(), &poolInfo, nullptr, &queries.statistics) != VK_SUCCESS) {
+				ELOG("Failed to create query pool!");
+				throw std::runtime_error("Failed to create query pool!");
+			}
+		}
+
+		m_enabled = true;
+	}
+
+	void VulkanGpuProfiler::destroy()
+	{
+		if (!m_enabled)
+			return;
+
+		for (uint32_t i = 0; i < m_frameCount; i++)
+		{
+			vkDestroyQueryPool(m_device->getDevice(), m_frames[i].timestamps, nullptr);
+			if (m_frames[i].statistics != VK_NULL_HANDLE)
+				vkDestroyQueryPool(m_device->getDevice(), m_frames[i].statistics, nullptr);
+		}
+
+		m_frames.reset();
+		m_results.clear();
+		m_enabled = false;
+	}
+
+	void VulkanGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frame)
+	{
+		if (!m_enabled)
+			return;
+
+		m_currentFrame = frame;
+		FrameQueries& queries = m_frames[frame];
+
+		//The caller has waited on this slot's fence, so everything it wrote is available without waiting
+		collect(queries);
+
+		vkCmdResetQueryPool(commandBuffer, queries.timestamps, 0, MAX_GPU_SCOPES * 2);
+		if (m_statistics)
+			vkCmdResetQueryPool(commandBuffer, queries.statistics, 0, MAX_GPU_SCOPES);
+		queries.scopeCount = 0;
+
+		m_frameScope = beginScope(commandBuffer, "frame");
+	}
+
+	void VulkanGpuProfiler::endFrame(VkCommandBuffer commandBuffer)
+	{
+		endScope(commandBuffer, m_frameScope);
+		m_frameScope = UINT32_MAX;
+	}
+
+	uint32_t VulkanGpuProfiler::beginScope(VkCommandBuffer commandBuffer, const std::string& name, bool statistics)
+	{
+		if (!m_enabled)
+			return UINT32_MAX;
+
+		FrameQueries& queries = m_frames[m_currentFrame];
+		uint32_t scope = queries.scopeCount.fetch_add(1);
+		if (scope >= MAX_GPU_SCOPES)
+			return UINT32_MAX;
+
+		queries.scopes[scope].name = name;
+		queries.scopes[scope].statistics = statistics && m_statistics;
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.timestamps, scope * 2);
+		if (queries.scopes[scope].statistics)
+			vkCmdBeginQuery(commandBuffer, queries.statistics, scope, 0);
+
+		return scope;
+	}
+
+	void VulkanGpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+	{
+		if (!m_enabled || scope == UINT32_MAX)
+			return;
+
+		FrameQueries& queries = m_frames[m_currentFrame];
+		if (queries.scopes[scope].statistics)
+			vkCmdEndQuery(commandBuffer, queries.statistics, scope);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries.timestamps, scope * 2 + 1);
+	}
+
+	void VulkanGpuProfiler::collect(FrameQueries& queries)
+	{
+		//Nothing read back leaves no results, rather than passing an older frame's off as this one's
+		m_results.clear();
+
+		uint32_t count = std::min(queries.scopeCount.load(), MAX_GPU_SCOPES);
+		if (count == 0)
+			return;
+
+		//A scope left open never gets its second timestamp, so the whole frame reads as not ready and is skipped
+		std::vector<uint64_t> timestamps(count * 2);
+		if (vkGetQueryPoolResults(m_device->getDevice(), queries.timestamps, 0, count * 2, timestamps.size() * sizeof(uint64_t), timestamps.data(),
+			sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+			return;
+
+		m_results.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			GpuScopeResult& result = m_results[i];
+			result = GpuScopeResult();
+			result.name = queries.scopes[i].name;
+
+			uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & m_timestampMask;
+			result.milliseconds = ticks * m_timestampPeriod / 1000000.0;
+
+			if (!queries.scopes[i].statistics)
+				continue;
+
+			std::array<uint64_t, 5> statistics = {};
+			if (vkGetQueryPoolResults(m_device->getDevice(), queries.statistics, i, 1, sizeof(statistics), statistics.data(),
+				sizeof(statistics), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+				continue;
+
+			result.hasStatistics = true;
+			result.inputPrimitives = statistics[0];
+			result.vertexInvocations = statistics[1];
+			result.clippingPrimitives = statistics[2];
+			result.fragmentInvocations = statistics[3];
+			result.computeInvocations = statistics[4];
+		}
+
+		publish();
+	}
+
+	void VulkanGpuProfiler::publish()
+	{
+		static Histogram* frameTime = Metrics::get().histogram("vengine_gpu_frame_time_ms", GPU_TIME_BOUNDS, "GPU time from the start to the end of a frame's command buffer");
+		static Gauge* lastFrameTime = Metrics::get().gauge("vengine_gpu_last_frame_time_us", "GPU time of the last frame read back");
+
+		for (const GpuScopeResult& result : m_results)
+		{
+			if (&result == &m_results[0])
+			{
+				frameTime->observe(result.milliseconds);
+				lastFrameTime->set(static_cast<int64_t>(result.milliseconds * 1000.0));
+				continue;
+			}
+
+			std::string labels = "pass=\"" + result.name + "\"";
+
+			Histogram*& passTime = m_passTimes[result.name];
+			if (passTime == nullptr)
+				passTime = Metrics::get().histogram("vengine_gpu_pass_time_ms", GPU_TIME_BOUNDS, "GPU time of each pass and draw group", labels);
+			passTime->observe(result.milliseconds);
+
+			if (!result.hasStatistics)
+				continue;
+
+			std::vector<Gauge*>& gauges = m_passStatistics[result.name];
+			if (gauges.empty())
+			{
+				for (const char* name : STATISTIC_NAMES)
+				{
+					gauges.push_back(Metrics::get().gauge(name, "Pipeline statistics of each pass in the last frame read back", labels));
+				}
+			}
+
+			gauges[0]->set(static_cast<int64_t>(result.inputPrimitives));
+			gauges[1]->set(static_cast<int64_t>(result.vertexInvocations));
+			gauges[2]->set(static_cast<int64_t>(result.clippingPrimitives));
+			gauges[3]->set(static_cast<int64_t>(result.fragmentInvocations));
+			gauges[4]->set(static_cast<int64_t>(result.computeInvocations));
+		}
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace VEngine {
+
+	class VulkanDevice;
+	class Histogram;
+	class Gauge;
+
+	//Scopes a frame can time, timestamps past this are dropped
+	const static uint32_t MAX_GPU_SCOPES = 64;
+
+	struct GpuScopeResult {
+		std::string name;
+		double milliseconds = 0.0;
+
+		//Only filled in for scopes begun with statistics, on devices with pipeline statistics queries
+		bool hasStatistics = false;
+		uint64_t inputPrimitives = 0;
+		uint64_t vertexInvocations = 0;
+		uint64_t clippingPrimitives = 0;
+		uint64_t fragmentInvocations = 0;
+		uint64_t computeInvocations = 0;
+	};
+
+	/*
+	 * GPU time per pass and per draw group, from timestamps written into a query pool per frame in flight. A frame's
+	 * queries are read back the next time its slot comes round, after its fence, so reading never waits on the GPU and
+	 * the results lag by the number of frames in flight.
+	 *
+	 * Each scope lands in the vengine_gpu_pass_time_ms histogram under its name, and scopes begun with statistics also
+	 * report the primitives and shader invocations they cost. Scopes may be begun from several recording threads at once.
+	 */
+	class VulkanGpuProfiler
+	{
+	public:
+		//Stays off, with every call doing nothing, when the graphics queue can't write timestamps
+		void create(VulkanDevice* device, uint32_t frameCount);
+		void destroy();
+
+		bool isEnabled() { return m_enabled; };
+
+		//Reads back what the frame last recorded into this slot and resets its queries, outside any render pass
+		void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+		void endFrame(VkCommandBuffer commandBuffer);
+
+		//statistics needs the scope outside a render pass or within one subpass, and no other statistics scope open
+		uint32_t beginScope(VkCommandBuffer commandBuffer, const std::string& name, bool statistics = false);
+		void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+		//The frame the last beginFrame read back, the frame itself first, empty when its queries weren't ready
+		const std::vector<GpuScopeResult>& getResults() { return m_results; };
+		double getFrameTime() { return m_results.empty() ? 0.0 : m_results[0].milliseconds; };
+
+	private:
+		struct Scope
+		{
+			std::string name;
+			bool statistics = false;
+		};
+
+		struct FrameQueries
+		{
+			VkQueryPool timestamps = VK_NULL_HANDLE;
+			VkQueryPool statistics = VK_NULL_HANDLE;
+			std::atomic<uint32_t> scopeCount{ 0 };
+			std::vector<Scope> scopes;
+		};
+
+		void collect(FrameQueries& queries);
+		void publish();
+
+		VulkanDevice* m_device = nullptr;
+		bool m_enabled = false;
+		bool m_statistics = false;
+
+		//Nanoseconds per tick, and the bits of a timestamp that count
+		double m_timestampPeriod = 1.0;
+		uint64_t m_timestampMask = ~0ull;
+
+		std::unique_ptr<FrameQueries[]> m_frames;
+		uint32_t m_frameCount = 0;
+		uint32_t m_currentFrame = 0;
+		uint32_t m_frameScope = UINT32_MAX;
+
+		std::vector<GpuScopeResult> m_results;
+		std::map<std::string, Histogram*> m_passTimes;
+		std::map<std::string, std::vector<Gauge*>> m_passStatistics;
+	};
+}
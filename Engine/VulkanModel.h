@@ -1,6 +1,9 @@
 #pragma once
 
 #include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <vector>
@@ -15,11 +18,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include "VulkanDevice.h"
 #include "VulkanBuffer.h"
-
-#define VERTEX_BUFFER_BIND_ID 0
+#include "VulkanGeometryPool.h"
 
 namespace VEngine
 {
@@ -33,9 +36,34 @@ namespace VEngine
 		VERTEX_COMPONENT_TANGENT = 0x4,
 		VERTEX_COMPONENT_BITANGENT = 0x5,
 		VERTEX_COMPONENT_DUMMY_FLOAT = 0x6,
-		VERTEX_COMPONENT_DUMMY_VEC4 = 0x7
+		VERTEX_COMPONENT_DUMMY_VEC4 = 0x7,
+		//Compressed formats, read by the shaders as the float components above.
+		//16 bit normalized positions over the model's bounds, Model::dequantize maps them back
+		VERTEX_COMPONENT_POSITION_UNORM16 = 0x8,
+		VERTEX_COMPONENT_POSITION_HALF = 0x9,
+		//Unit normals folded onto an octahedron, two 16 bit snorms decoded in the vertex shader
+		VERTEX_COMPONENT_NORMAL_OCT16 = 0xA,
+		VERTEX_COMPONENT_COLOR_UNORM8 = 0xB,
+		VERTEX_COMPONENT_UV_HALF = 0xC
 	} ModelVertexComponent;
 
+	//Octahedral encoding of a normal in [-1, 1]^2, see "A Survey of Efficient Representations for Independent Unit Vectors"
+	static glm::vec2 encodeOctahedral(glm::vec3 n)
+	{
+		float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (length <= 0.0f)
+			return glm::vec2(0.0f);
+
+		n /= length;
+		glm::vec2 encoded(n.x, n.y);
+		if (n.z < 0.0f)
+		{
+			encoded.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			encoded.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return encoded;
+	}
+
 
 
 	struct VertexLayout {
@@ -48,28 +76,99 @@ namespace VEngine
 			this->components = std::move(components);
 		}
 
+		//Bytes a component takes in the vertex, 16 and 8 bit formats are padded to keep attributes 4 byte aligned
+		static uint32_t componentSize(ModelVertexComponent component)
+		{
+			switch (component)
+			{
+			case VERTEX_COMPONENT_UV:
+				return 2 * sizeof(float);
+			case VERTEX_COMPONENT_DUMMY_FLOAT:
+				return sizeof(float);
+			case VERTEX_COMPONENT_DUMMY_VEC4:
+				return 4 * sizeof(float);
+			case VERTEX_COMPONENT_POSITION_UNORM16:
+			case VERTEX_COMPONENT_POSITION_HALF:
+				return 4 * sizeof(uint16_t);
+			case VERTEX_COMPONENT_NORMAL_OCT16:
+			case VERTEX_COMPONENT_UV_HALF:
+				return 2 * sizeof(uint16_t);
+			case VERTEX_COMPONENT_COLOR_UNORM8:
+				return 4 * sizeof(uint8_t);
+			default:
+				return 3 * sizeof(float);
+			}
+		}
+
+		static VkFormat componentFormat(ModelVertexComponent component)
+		{
+			switch (component)
+			{
+			case VERTEX_COMPONENT_UV:
+				return VK_FORMAT_R32G32_SFLOAT;
+			case VERTEX_COMPONENT_DUMMY_FLOAT:
+				return VK_FORMAT_R32_SFLOAT;
+			case VERTEX_COMPONENT_DUMMY_VEC4:
+				return VK_FORMAT_R32G32B32A32_SFLOAT;
+			//Three component 16 bit formats are rarely supported for vertex buffers, the fourth is left unused
+			case VERTEX_COMPONENT_POSITION_UNORM16:
+				return VK_FORMAT_R16G16B16A16_UNORM;
+			case VERTEX_COMPONENT_POSITION_HALF:
+				return VK_FORMAT_R16G16B16A16_SFLOAT;
+			case VERTEX_COMPONENT_NORMAL_OCT16:
+				return VK_FORMAT_R16G16_SNORM;
+			case VERTEX_COMPONENT_UV_HALF:
+				return VK_FORMAT_R16G16_SFLOAT;
+			case VERTEX_COMPONENT_COLOR_UNORM8:
+				return VK_FORMAT_R8G8B8A8_UNORM;
+			default:
+				return VK_FORMAT_R32G32B32_SFLOAT;
+			}
+		}
+
+		bool contains(ModelVertexComponent component) const
+		{
+			return std::find(components.begin(), components.end(), component) != components.end();
+		}
+
 		uint32_t stride()
 		{
 			uint32_t res = 0;
 			for (auto& component : components)
 			{
-				switch (component)
-				{
-				case VERTEX_COMPONENT_UV:
-					res += 2 * sizeof(float);
-					break;
-				case VERTEX_COMPONENT_DUMMY_FLOAT:
-					res += sizeof(float);
-					break;
-				case VERTEX_COMPONENT_DUMMY_VEC4:
-					res += 4 * sizeof(float);
-					break;
-				default:
-					res += 3 * sizeof(float);
-				}
+				res += componentSize(component);
 			}
 			return res;
 		}
+
+		VkVertexInputBindingDescription getBindingDescription()
+		{
+			VkVertexInputBindingDescription bindingDescription = {};
+			bindingDescription.binding = VERTEX_BUFFER_BIND_ID;
+			bindingDescription.stride = stride();
+			bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+			return bindingDescription;
+		}
+
+		//One attribute per component, at consecutive locations in the order they were listed
+		std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions()
+		{
+			std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+			uint32_t offset = 0;
+			for (auto& component : components)
+			{
+				VkVertexInputAttributeDescription attribute = {};
+				attribute.binding = VERTEX_BUFFER_BIND_ID;
+				attribute.location = static_cast<uint32_t>(attributeDescriptions.size());
+				attribute.offset = offset;
+				attribute.format = componentFormat(component);
+				offset += componentSize(component);
+
+				attributeDescriptions.push_back(attribute);
+			}
+			return attributeDescriptions;
+		}
 	};
 
 	struct ModelCreateInfo {
@@ -98,11 +197,15 @@ namespace VEngine
 
 	struct Model {
 		VkDevice device = nullptr;
-		VulkanBuffer vertices;
-		VulkanBuffer indices;
+		//Vertices and indices live in the device's geometry pool, see VulkanGeometryPool
+		VulkanGeometryPool* pool = nullptr;
+		GeometryAllocation geometry;
 		uint32_t indexCount = 0;
 		uint32_t vertexCount = 0;
 
+		//Transfer batch holding the vertex and index copies, see VulkanStagingBuffer::isComplete
+		uint64_t uploadSerial = 0;
+
 		struct ModelPart {
 			uint32_t vertexBase;
 			uint32_t vertexCount;
@@ -120,21 +223,19 @@ namespace VEngine
 			glm::vec3 size;
 		} dim;
 
+		//Set when positions were packed as VERTEX_COMPONENT_POSITION_UNORM16 over dim, the renderer folds dequantize
+		//into each instance's transform and culls against the unit cube the positions were packed into
+		bool quantized = false;
+		glm::mat4 dequantize = glm::mat4(1.0f);
+
 		void destroy()
 		{
 			assert(device);
-			if (vertices.getBuffer()) {
-				vkDestroyBuffer(device, vertices.getBuffer(), nullptr);
-				vkFreeMemory(device, vertices.getMemory(), nullptr);
-				if (indices.getBuffer() != VK_NULL_HANDLE)
-				{
-					vkDestroyBuffer(device, indices.getBuffer(), nullptr);
-					vkFreeMemory(device, indices.getMemory(), nullptr);
-				}
-			}
+			if (pool)
+				pool->free(geometry);
 		}
 
-		bool loadFromFile(const std::string& filename, VertexLayout layout, ModelCreateInfo* createInfo, VulkanDevice* device, VkQueue copyQueue)
+		bool loadFromFile(const std::string& filename, VertexLayout layout, ModelCreateInfo* createInfo, VulkanDevice* device)
 		{
 			this->device = device->getDevice();
 
@@ -165,12 +266,42 @@ namespace VEngine
 					center = createInfo->center;
 				}
 
-				std::vector<float> vertexBuffer;
+				std::vector<uint8_t> vertexBuffer;
 				std::vector<uint32_t> indexBuffer;
 
+				auto append = [&vertexBuffer](const void* data, size_t size) {
+					size_t offset = vertexBuffer.size();
+					vertexBuffer.resize(offset + size);
+					memcpy(vertexBuffer.data() + offset, data, size);
+				};
+
 				vertexCount = 0;
 				indexCount = 0;
 
+				//Bounds of the positions as uploaded, culling tests them against the object transforms.
+				//Found before packing, quantized positions are stored relative to them
+				dim = Dimension();
+				for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
+				{
+					const aiMesh* paiMesh = pScene->mMeshes[i];
+					for (unsigned int j = 0; j < paiMesh->mNumVertices; j++)
+					{
+						const aiVector3D& pPos = paiMesh->mVertices[j];
+						glm::vec3 pos(pPos.x * scale.x + center.x, pPos.y * scale.y + center.y, pPos.z * scale.z + center.z);
+						dim.max = glm::max(pos, dim.max);
+						dim.min = glm::min(pos, dim.min);
+					}
+				}
+				dim.size = dim.max - dim.min;
+
+				quantized = layout.contains(VERTEX_COMPONENT_POSITION_UNORM16);
+				dequantize = quantized ? glm::scale(glm::translate(glm::mat4(1.0f), dim.min), dim.size) : glm::mat4(1.0f);
+				//A flat axis packs to 0 rather than dividing by zero
+				glm::vec3 invSize = glm::vec3(
+					dim.size.x > 0.0f ? 1.0f / dim.size.x : 0.0f,
+					dim.size.y > 0.0f ? 1.0f / dim.size.y : 0.0f,
+					dim.size.z > 0.0f ? 1.0f / dim.size.z : 0.0f);
+
 				// Load meshes
 				for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
 				{
@@ -195,62 +326,81 @@ namespace VEngine
 						const aiVector3D* pTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mTangents[j]) : &Zero3D;
 						const aiVector3D* pBiTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mBitangents[j]) : &Zero3D;
 
+						glm::vec3 pos(pPos->x * scale.x + center.x, pPos->y * scale.y + center.y, pPos->z * scale.z + center.z);
+						glm::vec3 normal(pNormal->x, -pNormal->y, pNormal->z);
+						glm::vec2 uv(pTexCoord->x * uvscale.s, pTexCoord->y * uvscale.t);
+						glm::vec3 color(pColor.r, pColor.g, pColor.b);
+						glm::vec3 tangent(pTangent->x, pTangent->y, pTangent->z);
+						glm::vec3 bitangent(pBiTangent->x, pBiTangent->y, pBiTangent->z);
+
 						for (auto& component : layout.components)
 						{
 							switch (component) {
 							case VERTEX_COMPONENT_POSITION:
-								vertexBuffer.push_back(pPos->x * scale.x + center.x);
-								vertexBuffer.push_back(pPos->y * scale.y + center.y);
-								vertexBuffer.push_back(pPos->z * scale.z + center.z);
+								append(&pos, sizeof(pos));
 								break;
 							case VERTEX_COMPONENT_NORMAL:
-								vertexBuffer.push_back(pNormal->x);
-								vertexBuffer.push_back(-pNormal->y);
-								vertexBuffer.push_back(pNormal->z);
+								append(&normal, sizeof(normal));
 								break;
 							case VERTEX_COMPONENT_UV:
-								vertexBuffer.push_back(pTexCoord->x * uvscale.s);
-								vertexBuffer.push_back(pTexCoord->y * uvscale.t);
+								append(&uv, sizeof(uv));
 								break;
 							case VERTEX_COMPONENT_COLOR:
-								vertexBuffer.push_back(pColor.r);
-								vertexBuffer.push_back(pColor.g);
-								vertexBuffer.push_back(pColor.b);
+								append(&color, sizeof(color));
 								break;
 							case VERTEX_COMPONENT_TANGENT:
-								vertexBuffer.push_back(pTangent->x);
-								vertexBuffer.push_back(pTangent->y);
-								vertexBuffer.push_back(pTangent->z);
+								append(&tangent, sizeof(tangent));
 								break;
 							case VERTEX_COMPONENT_BITANGENT:
-								vertexBuffer.push_back(pBiTangent->x);
-								vertexBuffer.push_back(pBiTangent->y);
-								vertexBuffer.push_back(pBiTangent->z);
+								append(&bitangent, sizeof(bitangent));
 								break;
 								// Dummy components for padding
 							case VERTEX_COMPONENT_DUMMY_FLOAT:
-								vertexBuffer.push_back(0.0f);
+							{
+								float zero = 0.0f;
+								append(&zero, sizeof(zero));
 								break;
+							}
 							case VERTEX_COMPONENT_DUMMY_VEC4:
-								vertexBuffer.push_back(0.0f);
-								vertexBuffer.push_back(0.0f);
-								vertexBuffer.push_back(0.0f);
-								vertexBuffer.push_back(0.0f);
+							{
+								glm::vec4 zero(0.0f);
+								append(&zero, sizeof(zero));
+								break;
+							}
+							case VERTEX_COMPONENT_POSITION_UNORM16:
+							{
+								uint64_t packed = glm::packUnorm4x16(glm::vec4(glm::clamp((pos - dim.min) * invSize, 0.0f, 1.0f), 0.0f));
+								append(&packed, sizeof(packed));
+								break;
+							}
+							case VERTEX_COMPONENT_POSITION_HALF:
+							{
+								uint64_t packed = glm::packHalf4x16(glm::vec4(pos, 1.0f));
+								append(&packed, sizeof(packed));
+								break;
+							}
+							case VERTEX_COMPONENT_NORMAL_OCT16:
+							{
+								uint32_t packed = glm::packSnorm2x16(encodeOctahedral(normal));
+								append(&packed, sizeof(packed));
 								break;
+							}
+							case VERTEX_COMPONENT_COLOR_UNORM8:
+							{
+								uint32_t packed = glm::packUnorm4x8(glm::vec4(glm::clamp(color, 0.0f, 1.0f), 1.0f));
+								append(&packed, sizeof(packed));
+								break;
+							}
+							case VERTEX_COMPONENT_UV_HALF:
+							{
+								uint32_t packed = glm::packHalf2x16(uv);
+								append(&packed, sizeof(packed));
+								break;
+							}
 							};
 						}
-
-						dim.max.x = fmax(pPos->x, dim.max.x);
-						dim.max.y = fmax(pPos->y, dim.max.y);
-						dim.max.z = fmax(pPos->z, dim.max.z);
-
-						dim.min.x = fmin(pPos->x, dim.min.x);
-						dim.min.y = fmin(pPos->y, dim.min.y);
-						dim.min.z = fmin(pPos->z, dim.min.z);
 					}
 
-					dim.size = dim.max - dim.min;
-
 					parts[i].vertexCount = paiMesh->mNumVertices;
 
 					uint32_t indexBase = static_cast<uint32_t>(indexBuffer.size());
@@ -268,72 +418,15 @@ namespace VEngine
 				}
 
 
-				uint32_t vBufferSize = static_cast<uint32_t>(vertexBuffer.size()) * sizeof(float);
+				uint32_t vBufferSize = static_cast<uint32_t>(vertexBuffer.size());
 				uint32_t iBufferSize = static_cast<uint32_t>(indexBuffer.size()) * sizeof(uint32_t);
 
-				// Use staging buffer to move vertex and index buffer to device local memory
-				// Create staging buffers
-				VulkanBuffer vertexStaging, indexStaging;
-
-				// Vertex staging buffer
-				if (device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					&vertexStaging,
-					vBufferSize,
-					vertexBuffer.data()) != VK_SUCCESS) {
-					ELOG("Failed to create vertex staging buffer!");
-					throw std::runtime_error("Failed to create vertex staging buffer!");
-				}
-
-				// Index staging buffer
-				if (device->createBuffer(
-					VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					&indexStaging,
-					iBufferSize,
-					indexBuffer.data())) {
-					ELOG("Failed to create index staging buffer!");
-					throw std::runtime_error("Failed to create index staging buffer!");
-				}
-
-				// Create device local target buffers
-				// Vertex buffer
-				if (device->createBuffer(
-					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | createInfo->memoryPropertyFlags,
-					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					&vertices,
-					vBufferSize)) {
-					ELOG("Failed to create vertex buffer!");
-					throw std::runtime_error("Failed to create vertex buffer!");
-				}
-
-				// Index buffer
-				if (device->createBuffer(
-					VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | createInfo->memoryPropertyFlags,
-					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					&indices,
-					iBufferSize)) {
-					ELOG("Failed to create index buffer!");
-					throw std::runtime_error("Failed to create index buffer!");
-				}
-
-				// Copy from staging buffers
-				VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-				VkBufferCopy copyRegion{};
-
-				copyRegion.size = vertices.getSize();
-				vkCmdCopyBuffer(copyCmd, vertexStaging.getBuffer(), vertices.getBuffer(), 1, &copyRegion);
-
-				copyRegion.size = indices.getSize();
-				vkCmdCopyBuffer(copyCmd, indexStaging.getBuffer(), indices.getBuffer(), 1, &copyRegion);
-
-				device->flushCommandBuffer(copyCmd, copyQueue);
-
-				// Destroy staging resources
-				vkDestroyBuffer(device->getDevice(), vertexStaging.getBuffer(), nullptr);
-				vkFreeMemory(device->getDevice(), vertexStaging.getMemory(), nullptr);
-				vkDestroyBuffer(device->getDevice(), indexStaging.getBuffer(), nullptr);
-				vkFreeMemory(device->getDevice() , indexStaging.getMemory(), nullptr);
+				// Sub-allocate from the geometry pool, the copies go out with the next frame's upload batch
+				// and the model isn't drawn until that batch has completed
+				pool = device->getGeometryPool();
+				geometry = pool->upload(vertexBuffer.data(), vBufferSize, layout.stride(), indexBuffer.data(), iBufferSize);
+				VulkanStagingBuffer* staging = device->getTransferStagingBuffer();
+				uploadSerial = staging->getUploadSerial();
 
 				return true;
 			}
@@ -348,24 +441,36 @@ namespace VEngine
 		};
 
 
-		bool loadFromFile(const std::string& filename, VertexLayout layout, ModelCreateInfo info, VulkanDevice* device, VkQueue copyQueue)
+		bool loadFromFile(const std::string& filename, VertexLayout layout, ModelCreateInfo info, VulkanDevice* device)
 		{
-			return loadFromFile(filename, layout, &info, device, copyQueue);
+			return loadFromFile(filename, layout, &info, device);
 		}
 	};
 
 	struct VulkanModelComponent
 	{
 		Model* model;
-		VkPipeline* pipeline;
+		//Left null for the renderer's default pipeline, or taken from VulkanRenderer::requestPipeline
+		VkPipeline* pipeline = nullptr;
+
+		//World transform, written to the object buffer every frame
+		glm::mat4 transform = glm::mat4(1.0f);
+
+		//Position within the renderer's instance batch for this model and pipeline
+		uint32_t instanceIndex = 0;
+
+		//Result of the CPU frustum test, left set when the GPU culls instead
+		bool visible = true;
+
+		//Slot in the renderer's bindless texture array, see VulkanRenderer::addTexture
+		uint32_t textureIndex = 0;
 	};
 
-	static void draw(VulkanModelComponent* comp, VkCommandBuffer cmdBuffer)
+	//Instances read their data from the object buffer at gl_InstanceIndex, which starts at firstInstance
+	static void draw(Model* model, VkPipeline pipeline, VkCommandBuffer cmdBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0)
 	{
-		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *comp->pipeline);
-		vkCmdBindVertexBuffers(cmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &comp->model->vertices.getBuffer(), offsets);
-		vkCmdBindIndexBuffer(cmdBuffer, comp->model->indices.getBuffer(), 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(cmdBuffer, comp->model->indexCount, 1, 0, 0, 0);
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		model->pool->bind(cmdBuffer, model->geometry.block);
+		vkCmdDrawIndexed(cmdBuffer, model->indexCount, instanceCount, model->geometry.firstIndex, model->geometry.firstVertex, firstInstance);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "VulkanPerFrameBuffer.h"
+#include "VulkanDevice.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace VEngine {
+
+	void VulkanPerFrameBuffer::create(VulkanDevice* device, VkBufferUsageFlags usage, VkDeviceSize frameSize, uint32_t frameCount, bool coherent)
+	{
+		const VkPhysicalDeviceLimits& limits = device->getProperties().limits;
+
+		//Every slice has to be a valid dynamic offset, and flushing one must never touch its neighbours
+		VkDeviceSize alignment = std::max<VkDeviceSize>(limits.nonCoherentAtomSize, 1);
+		if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+			alignment = std::max(alignment, limits.minUniformBufferOffsetAlignment);
+		if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+			alignment = std::max(alignment, limits.minStorageBufferOffsetAlignment);
+
+		m_frameSize = frameSize;
+		m_frameStride = (frameSize + alignment - 1) / alignment * alignment;
+		m_frameCount = frameCount;
+		m_coherent = coherent;
+
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		if (coherent)
+			properties |= VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		if (device->createBuffer(usage, properties, &m_buffer, m_frameStride * frameCount) != VK_SUCCESS) {
+			ELOG("Failed to create per frame buffer!");
+			throw std::runtime_error("Failed to create per frame buffer!");
+		}
+
+		if (m_buffer.map() != VK_SUCCESS) {
+			ELOG("Failed to map per frame buffer!");
+			throw std::runtime_error("Failed to map per frame buffer!");
+		}
+
+		//A non-coherent request can still land on coherent memory, skip the flushes when it does
+		uint32_t memoryType = m_buffer.getAllocation().memoryType;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		vkGetPhysicalDeviceMemoryProperties(device->getPhysicalDevice(), &memoryProperties);
+		if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+			m_coherent = true;
+	}
+
+	void VulkanPerFrameBuffer::destroy()
+	{
+		m_buffer.unmap();
+		m_buffer.destroy();
+	}
+
+	void VulkanPerFrameBuffer::write(uint32_t frame, const void* data, VkDeviceSize size, VkDeviceSize offset)
+	{
+		assert(offset + size <= m_frameSize);
+		memcpy(static_cast<char*>(getFrame(frame)) + offset, data, (size_t)size);
+
+		flush(frame, size, offset);
+	}
+
+	void VulkanPerFrameBuffer::flush(uint32_t frame, VkDeviceSize size, VkDeviceSize offset)
+	{
+		if (m_coherent || size == 0)
+			return;
+
+		if (size == VK_WHOLE_SIZE)
+			size = m_frameSize - offset;
+
+		m_buffer.flush(size, getFrameOffset(frame) + offset);
+	}
+
+	VkDescriptorBufferInfo VulkanPerFrameBuffer::getDescriptor(uint32_t frame)
+	{
+		VkDescriptorBufferInfo descriptor = {};
+		descriptor.buffer = m_buffer.getBuffer();
+		descriptor.offset = getFrameOffset(frame);
+		descriptor.range = m_frameSize;
+		return descriptor;
+	}
+}
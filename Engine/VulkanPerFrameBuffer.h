@@ -0,0 +1,45 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "VulkanBuffer.h"
+
+namespace VEngine {
+
+	class VulkanDevice;
+
+	/*
+	 * One host visible buffer split into a slice per frame, mapped once at creation and kept mapped.
+	 * Slices are aligned for dynamic offsets and for non-coherent flushes, so writing a frame's data
+	 * is a memcpy, plus a flush of just that slice when the memory isn't host coherent.
+	 */
+	class VulkanPerFrameBuffer
+	{
+	public:
+		void create(VulkanDevice* device, VkBufferUsageFlags usage, VkDeviceSize frameSize, uint32_t frameCount, bool coherent = true);
+		void destroy();
+
+		void write(uint32_t frame, const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+
+		//For callers that fill the slice in place through getFrame(), a no-op on coherent memory
+		void flush(uint32_t frame, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+		void* getFrame(uint32_t frame) { return static_cast<char*>(m_buffer.getMapped()) + getFrameOffset(frame); };
+		VkDeviceSize getFrameOffset(uint32_t frame) { return frame * m_frameStride; };
+
+		VkDescriptorBufferInfo getDescriptor(uint32_t frame);
+
+		VkBuffer& getBuffer() { return m_buffer.getBuffer(); };
+		VkDeviceSize getFrameSize() { return m_frameSize; };
+		VkDeviceSize getFrameStride() { return m_frameStride; };
+		uint32_t getFrameCount() { return m_frameCount; };
+		bool isCoherent() { return m_coherent; };
+
+	private:
+		VulkanBuffer m_buffer;
+
+		VkDeviceSize m_frameSize = 0;
+		VkDeviceSize m_frameStride = 0;
+		uint32_t m_frameCount = 0;
+		bool m_coherent = true;
+	};
+}
@@ -0,0 +1,105 @@
+#include "VulkanPipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#define LOGGING_LEVEL_1
+#include "Logger.h"
+#include "Metrics.h"
+
+namespace VEngine {
+
+	void VulkanPipelineCache::create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path)
+	{
+		m_device = device;
+		m_path = path;
+
+		std::vector<char> data;
+		std::ifstream file(m_path, std::ios::binary);
+		if (file.is_open()) {
+			data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			if (!isCompatible(data, properties)) {
+				WLOG("Pipeline cache was written by another device or driver, starting empty!");
+				data.clear();
+			}
+		}
+
+		VkPipelineCacheCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		createInfo.initialDataSize = data.size();
+		createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+		if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache) != VK_SUCCESS) {
+			ELOG("Failed to create pipeline cache!");
+			throw std::runtime_error("Failed to create pipeline cache!");
+		}
+
+		static Gauge* loaded = Metrics::get().gauge("vengine_pipeline_cache_loaded_bytes", "Size of the pipeline cache read from disk at startup");
+		loaded->set(static_cast<int64_t>(data.size()));
+	}
+
+	bool VulkanPipelineCache::isCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties)
+	{
+		//VkPipelineCacheHeaderVersionOne, read field by field since the blob has no alignment guarantees
+		const size_t headerSize = 16 + VK_UUID_SIZE;
+		if (data.size() < headerSize)
+			return false;
+
+		uint32_t length, version, vendorID, deviceID;
+		std::memcpy(&length, data.data(), 4);
+		std::memcpy(&version, data.data() + 4, 4);
+		std::memcpy(&vendorID, data.data() + 8, 4);
+		std::memcpy(&deviceID, data.data() + 12, 4);
+
+		return length >= headerSize && length <= data.size()
+			&& version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			&& vendorID == properties.vendorID
+			&& deviceID == properties.deviceID
+			&& std::memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	bool VulkanPipelineCache::save()
+	{
+		if (m_cache == VK_NULL_HANDLE)
+			return false;
+
+		size_t size = 0;
+		if (vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+			return false;
+
+		std::vector<char> data(size);
+		if (vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS)
+			return false;
+
+		//Written beside the old cache and moved over it, so a crash mid write leaves the last good one
+		std::string tempPath = m_path + ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open() || !file.write(data.data(), size)) {
+				WLOG("Failed to write pipeline cache!");
+				return false;
+			}
+		}
+
+		std::remove(m_path.c_str());
+		if (std::rename(tempPath.c_str(), m_path.c_str()) != 0) {
+			WLOG("Failed to replace pipeline cache!");
+			return false;
+		}
+
+		return true;
+	}
+
+	void VulkanPipelineCache::destroy()
+	{
+		if (m_cache == VK_NULL_HANDLE)
+			return;
+
+		save();
+		vkDestroyPipelineCache(m_device, m_cache, nullptr);
+		m_cache = VK_NULL_HANDLE;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+namespace VEngine {
+
+	const static char* const PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+	/*
+	 * VkPipelineCache kept on disk between runs, so pipelines compiled once are looked up instead of rebuilt by the driver.
+	 * The saved blob is only handed back to the driver when its header matches the device it was written on: a driver
+	 * update or a different GPU changes the UUID, and the cache then starts out empty and is overwritten on the next save.
+	 */
+	class VulkanPipelineCache
+	{
+	public:
+		void create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path = PIPELINE_CACHE_FILE);
+		//Writes the cache back to disk before destroying it
+		void destroy();
+
+		bool save();
+
+		VkPipelineCache getCache() { return m_cache; };
+
+	private:
+		bool isCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties);
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkPipelineCache m_cache = VK_NULL_HANDLE;
+		std::string m_path;
+	};
+}
@@ -0,0 +1,401 @@
+#include "VulkanPipelineRegistry.h"
+#include "VulkanDevice.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <iterator>
+
+namespace VEngine {
+
+	static bool readShader(const std::string& filename, std::vector<char>& code)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			return false;
+
+		code.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return !code.empty();
+	}
+
+	//FNV-1a, fed field by field so padding never reaches the hash
+	static void hashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	template<typename T>
+	static void hashValue(uint64_t& hash, const T& value)
+	{
+		hashBytes(hash, &value, sizeof(T));
+	}
+
+	static bool sameDesc(const PipelineDesc& a, const PipelineDesc& b)
+	{
+		return a.vertexShader == b.vertexShader && a.fragmentShader == b.fragmentShader && a.vertexLayout.components == b.vertexLayout.components &&
+			a.renderPass == b.renderPass && a.subpass == b.subpass && a.layout == b.layout && a.samples == b.samples &&
+			a.topology == b.topology && a.polygonMode == b.polygonMode && a.cullMode == b.cullMode && a.frontFace == b.frontFace &&
+			a.depthTest == b.depthTest && a.depthWrite == b.depthWrite && a.depthCompare == b.depthCompare && a.blend == b.blend;
+	}
+
+	void VulkanPipelineRegistry::create(VulkanDevice* device)
+	{
+		m_device = device;
+		m_stopping = false;
+		m_compileThread = std::thread(&VulkanPipelineRegistry::compileLoop, this);
+	}
+
+	void VulkanPipelineRegistry::destroy()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+			m_queue.clear();
+		}
+		m_wake.notify_all();
+
+		if (m_compileThread.joinable())
+			m_compileThread.join();
+
+		update();
+
+		for (auto& entry : m_entries)
+		{
+			vkDestroyPipeline(m_device->getDevice(), entry.second->compiled, nullptr);
+		}
+		m_entries.clear();
+	}
+
+	uint64_t VulkanPipelineRegistry::hash(const PipelineDesc& desc)
+	{
+		uint64_t hash = 14695981039346656037ull;
+
+		//The file names rather than the code, so a lookup never touches the disk
+		hashBytes(hash, desc.vertexShader.data(), desc.vertexShader.size());
+		hashValue(hash, desc.vertexShader.size());
+		hashBytes(hash, desc.fragmentShader.data(), desc.fragmentShader.size());
+		hashValue(hash, desc.fragmentShader.size());
+
+		for (ModelVertexComponent component : desc.vertexLayout.components)
+		{
+			hashValue(hash, component);
+		}
+		hashValue(hash, desc.vertexLayout.components.size());
+
+		hashValue(hash, desc.renderPass);
+		hashValue(hash, desc.subpass);
+		hashValue(hash, desc.layout);
+		hashValue(hash, desc.samples);
+		hashValue(hash, desc.topology);
+		hashValue(hash, desc.polygonMode);
+		hashValue(hash, desc.cullMode);
+		hashValue(hash, desc.frontFace);
+		hashValue(hash, desc.depthTest);
+		hashValue(hash, desc.depthWrite);
+		hashValue(hash, desc.depthCompare);
+		hashValue(hash, desc.blend);
+
+		return hash;
+	}
+
+	VulkanPipelineRegistry::Entry* VulkanPipelineRegistry::findOrAdd(const PipelineDesc& desc, VkPipeline* fallback, bool& added)
+	{
+		added = false;
+
+		uint64_t key = hash(desc);
+		auto range = m_entries.equal_range(key);
+		for (auto found = range.first; found != range.second; found++)
+		{
+			if (sameDesc(found->second->desc, desc))
+				return found->second.get();
+		}
+
+		std::unique_ptr<Entry> entry(new Entry());
+		entry->desc = desc;
+		entry->fallback = fallback;
+		entry->pipeline = fallback ? *fallback : VK_NULL_HANDLE;
+		added = true;
+		return m_entries.insert({ key, std::move(entry) })->second.get();
+	}
+
+	VkPipeline* VulkanPipelineRegistry::request(const PipelineDesc& desc, VkPipeline* fallback)
+	{
+		bool added;
+		Entry* entry = findOrAdd(desc, fallback, added);
+
+		if (added)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(entry);
+			}
+			m_wake.notify_one();
+		}
+
+		return &entry->pipeline;
+	}
+
+	VkPipeline* VulkanPipelineRegistry::requestNow(const PipelineDesc& desc)
+	{
+		bool added;
+		Entry* entry = findOrAdd(desc, nullptr, added);
+
+		if (added)
+		{
+			entry->compiled = compile(*entry);
+			if (entry->compiled == VK_NULL_HANDLE) {
+				ELOG("Failed to create graphics pipeline!");
+				throw std::runtime_error("Failed to create graphics pipeline!");
+			}
+			entry->pipeline = entry->compiled;
+		}
+
+		return &entry->pipeline;
+	}
+
+	void VulkanPipelineRegistry::update()
+	{
+		std::vector<std::pair<Entry*, VkPipeline>> finished;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			finished.swap(m_finished);
+		}
+
+		for (auto& result : finished)
+		{
+			if (result.second == VK_NULL_HANDLE) {
+				WLOG("Failed to compile pipeline, drawing with the fallback!");
+				continue;
+			}
+
+			result.first->compiled = result.second;
+			result.first->pipeline = result.second;
+		}
+
+		static Gauge* pending = Metrics::get().gauge("vengine_pipelines_pending", "Pipelines still compiling in the background");
+		pending->set(static_cast<int64_t>(getPendingCount()));
+	}
+
+	size_t VulkanPipelineRegistry::getPendingCount()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_queue.size() + (m_compiling ? 1 : 0) + m_finished.size();
+	}
+
+	void VulkanPipelineRegistry::waitIdle()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_queue.empty() && !m_compiling; });
+	}
+
+	std::function<void()> VulkanPipelineRegistry::recreate(VkRenderPass oldPass, VkRenderPass newPass)
+	{
+		waitIdle();
+		update();
+
+		std::vector<VkPipeline> retired;
+		std::unordered_multimap<uint64_t, std::unique_ptr<Entry>> entries;
+		for (auto& found : m_entries)
+		{
+			Entry* entry = found.second.get();
+			if (entry->desc.renderPass == oldPass)
+			{
+				retired.push_back(entry->compiled);
+				entry->desc.renderPass = newPass;
+				entry->compiled = compile(*entry);
+			}
+
+			entries.insert({ hash(entry->desc), std::move(found.second) });
+		}
+		m_entries.swap(entries);
+
+		//Second pass, a fallback may have been rebuilt after the entries pointing at it
+		for (auto& found : m_entries)
+		{
+			Entry* entry = found.second.get();
+			if (entry->compiled != VK_NULL_HANDLE)
+				entry->pipeline = entry->compiled;
+			else
+				entry->pipeline = entry->fallback ? *entry->fallback : VK_NULL_HANDLE;
+		}
+
+		VkDevice device = m_device->getDevice();
+		return [device, retired]() {
+			for (VkPipeline pipeline : retired)
+			{
+				vkDestroyPipeline(device, pipeline, nullptr);
+			}
+		};
+	}
+
+	void VulkanPipelineRegistry::compileLoop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_wake.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+			if (m_stopping)
+				break;
+
+			Entry* entry = m_queue.front();
+			m_queue.pop_front();
+			m_compiling = true;
+
+			//The entry's description doesn't change while it's queued, so it can be compiled unlocked
+			lock.unlock();
+			VkPipeline pipeline = compile(*entry);
+			lock.lock();
+
+			m_finished.push_back({ entry, pipeline });
+			m_compiling = false;
+
+			if (m_queue.empty())
+				m_idle.notify_all();
+		}
+
+		m_compiling = false;
+		m_idle.notify_all();
+	}
+
+	VkShaderModule VulkanPipelineRegistry::createShaderModule(const std::vector<char>& code)
+	{
+		VkShaderModuleCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = code.size();
+		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+		VkShaderModule shaderModule = VK_NULL_HANDLE;
+		vkCreateShaderModule(m_device->getDevice(), &createInfo, nullptr, &shaderModule);
+		return shaderModule;
+	}
+
+	//Called from the compile thread as well, so it only reports failure through the handle it returns
+	VkPipeline VulkanPipelineRegistry::compile(Entry& entry)
+	{
+		const PipelineDesc& desc = entry.desc;
+
+		//Read on first use, so requests never wait on the disk
+		if (entry.vertexCode.empty() && !readShader(desc.vertexShader, entry.vertexCode))
+			return VK_NULL_HANDLE;
+		if (entry.fragmentCode.empty() && !readShader(desc.fragmentShader, entry.fragmentCode))
+			return VK_NULL_HANDLE;
+
+		VkShaderModule vertShaderModule = createShaderModule(entry.vertexCode);
+		VkShaderModule fragShaderModule = createShaderModule(entry.fragmentCode);
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		if (vertShaderModule != VK_NULL_HANDLE && fragShaderModule != VK_NULL_HANDLE)
+		{
+			VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+			shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+			shaderStages[0].module = vertShaderModule;
+			shaderStages[0].pName = "main";
+
+			shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+			shaderStages[1].module = fragShaderModule;
+			shaderStages[1].pName = "main";
+
+			VertexLayout layout = desc.vertexLayout;
+			auto bindingDescription = layout.getBindingDescription();
+			auto attributeDescriptions = layout.getAttributeDescriptions();
+
+			VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+			vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+			vertexInputInfo.vertexBindingDescriptionCount = attributeDescriptions.empty() ? 0 : 1;
+			vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+			vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+			vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+			VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+			inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+			inputAssembly.topology = desc.topology;
+			inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+			//Viewport and scissor are set while recording, so pipelines don't depend on the window size
+			VkPipelineViewportStateCreateInfo viewportState = {};
+			viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+			viewportState.viewportCount = 1;
+			viewportState.scissorCount = 1;
+
+			VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+			VkPipelineDynamicStateCreateInfo dynamicState = {};
+			dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+			dynamicState.dynamicStateCount = 2;
+			dynamicState.pDynamicStates = dynamicStates;
+
+			VkPipelineRasterizationStateCreateInfo rasterizer = {};
+			rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+			rasterizer.depthClampEnable = VK_FALSE;
+			rasterizer.rasterizerDiscardEnable = VK_FALSE;
+			rasterizer.polygonMode = desc.polygonMode;
+			rasterizer.lineWidth = 1.0f;
+			rasterizer.cullMode = desc.cullMode;
+			rasterizer.frontFace = desc.frontFace;
+			rasterizer.depthBiasEnable = VK_FALSE;
+
+			VkPipelineMultisampleStateCreateInfo multisampling = {};
+			multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+			multisampling.sampleShadingEnable = VK_FALSE;
+			multisampling.minSampleShading = .0f;
+			multisampling.rasterizationSamples = desc.samples;
+
+			VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+			depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+			depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+			depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+			depthStencil.depthCompareOp = desc.depthCompare;
+			depthStencil.depthBoundsTestEnable = VK_FALSE;
+			depthStencil.stencilTestEnable = VK_FALSE;
+
+			VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+			colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+			colorBlendAttachment.blendEnable = desc.blend ? VK_TRUE : VK_FALSE;
+			colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+			colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+			colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+			colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+			colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+			VkPipelineColorBlendStateCreateInfo colorBlending = {};
+			colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+			colorBlending.logicOpEnable = VK_FALSE;
+			colorBlending.logicOp = VK_LOGIC_OP_COPY;
+			colorBlending.attachmentCount = 1;
+			colorBlending.pAttachments = &colorBlendAttachment;
+
+			VkGraphicsPipelineCreateInfo pipelineInfo = {};
+			pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			pipelineInfo.stageCount = 2;
+			pipelineInfo.pStages = shaderStages;
+			pipelineInfo.pVertexInputState = &vertexInputInfo;
+			pipelineInfo.pInputAssemblyState = &inputAssembly;
+			pipelineInfo.pViewportState = &viewportState;
+			pipelineInfo.pRasterizationState = &rasterizer;
+			pipelineInfo.pMultisampleState = &multisampling;
+			pipelineInfo.pColorBlendState = &colorBlending;
+			pipelineInfo.pDepthStencilState = &depthStencil;
+			pipelineInfo.pDynamicState = &dynamicState;
+			pipelineInfo.layout = desc.layout;
+			pipelineInfo.renderPass = desc.renderPass;
+			pipelineInfo.subpass = desc.subpass;
+			pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+			//The pipeline cache is internally synchronized, so the compile thread and the main thread can share it
+			if (vkCreateGraphicsPipelines(m_device->getDevice(), m_device->getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+				pipeline = VK_NULL_HANDLE;
+		}
+
+		vkDestroyShaderModule(m_device->getDevice(), fragShaderModule, nullptr);
+		vkDestroyShaderModule(m_device->getDevice(), vertShaderModule, nullptr);
+
+		return pipeline;
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "VulkanModel.h"
+
+namespace VEngine {
+
+	class VulkanDevice;
+
+	//Everything a graphics pipeline is built from, viewport and scissor are always dynamic
+	struct PipelineDesc {
+		std::string vertexShader;
+		std::string fragmentShader;
+		VertexLayout vertexLayout = VertexLayout(std::vector<ModelVertexComponent>());
+
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		uint32_t subpass = 0;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+		VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+		bool depthTest = true;
+		bool depthWrite = true;
+		VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+
+		bool blend = false;
+	};
+
+	/*
+	 * Graphics pipelines shared by everything drawn with the same state, looked up by a hash of the shader files, the
+	 * vertex layout, the render pass and the fixed function state. The SPIR-V is only read once a pipeline is compiled.
+	 *
+	 * request() hands back a VkPipeline* that stays valid until destroy(). A pipeline not seen before is compiled on a
+	 * background thread while the handle holds the fallback, and update() swaps the real pipeline in between frames,
+	 * so a new material never stalls a frame on the driver's compiler.
+	 */
+	class VulkanPipelineRegistry
+	{
+	public:
+		void create(VulkanDevice* device);
+		void destroy();
+
+		//Compiled in the background, fallback is drawn with until then
+		VkPipeline* request(const PipelineDesc& desc, VkPipeline* fallback);
+		//Compiled on the calling thread before returning, for the pipelines everything else falls back to
+		VkPipeline* requestNow(const PipelineDesc& desc);
+
+		//Publishes the pipelines finished since the last call, before recording a frame
+		void update();
+
+		//Rebuilds every pipeline made for oldPass against newPass, the handles given out stay the same.
+		//Returns what destroys the old pipelines, to run once the frames drawn with them are done.
+		std::function<void()> recreate(VkRenderPass oldPass, VkRenderPass newPass);
+
+		size_t getPendingCount();
+
+	private:
+		struct Entry
+		{
+			PipelineDesc desc;
+			//Read by the first compile, kept for rebuilds against a new render pass
+			std::vector<char> vertexCode;
+			std::vector<char> fragmentCode;
+			VkPipeline* fallback = nullptr;
+
+			//What the handle given out points at, the fallback until compiled is ready
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			VkPipeline compiled = VK_NULL_HANDLE;
+		};
+
+		Entry* findOrAdd(const PipelineDesc& desc, VkPipeline* fallback, bool& added);
+		uint64_t hash(const PipelineDesc& desc);
+		VkPipeline compile(Entry& entry);
+		VkShaderModule createShaderModule(const std::vector<char>& code);
+
+		void compileLoop();
+		void waitIdle();
+
+		VulkanDevice* m_device = nullptr;
+
+		//Entries are held by pointer so the handles stay put when the map rehashes, descriptions sharing a hash sit side by side
+		std::unordered_multimap<uint64_t, std::unique_ptr<Entry>> m_entries;
+
+		std::thread m_compileThread;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_idle;
+		std::deque<Entry*> m_queue;
+		std::vector<std::pair<Entry*, VkPipeline>> m_finished;
+		bool m_compiling = false;
+		bool m_stopping = false;
+	};
+}
@@ -0,0 +1,608 @@
+#include "VulkanRenderGraph.h"
+#include "VulkanDevice.h"
+#include "VulkanGpuProfiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Metrics.h"
+
+namespace VEngine {
+
+	//Access bits that leave something behind to be made available, the rest only ever need an execution dependency
+	static const VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	static VkPipelineStageFlags getShaderStages(RenderPassType type)
+	{
+		switch (type)
+		{
+		case RenderPassType::Graphics:
+			return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		case RenderPassType::Compute:
+			return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		default:
+			ELOG("Transfer passes can't use resources in shaders!");
+			throw std::runtime_error("Transfer passes can't use resources in shaders!");
+		}
+	}
+
+	void RenderPassBuilder::read(RenderResource resource, RenderUsage usage)
+	{
+		m_graph->addAccess(m_pass, resource, usage, false);
+	}
+
+	void RenderPassBuilder::write(RenderResource resource, RenderUsage usage)
+	{
+		m_graph->addAccess(m_pass, resource, usage, true);
+	}
+
+	void VulkanRenderGraph::create(VulkanDevice* device)
+	{
+		m_device = device;
+	}
+
+	void VulkanRenderGraph::destroy()
+	{
+		if (m_device == nullptr)
+			return;
+
+		release()();
+	}
+
+	std::function<void()> VulkanRenderGraph::release()
+	{
+		std::vector<VkImageView> views;
+		std::vector<VkImage> images;
+		std::vector<VulkanAllocation> allocations;
+
+		for (Resource& resource : m_resources)
+		{
+			if (resource.imported)
+				continue;
+
+			if (resource.view != VK_NULL_HANDLE)
+				views.push_back(resource.view);
+			if (resource.image != VK_NULL_HANDLE)
+				images.push_back(resource.image);
+		}
+
+		for (MemorySlot& slot : m_slots)
+		{
+			allocations.push_back(slot.allocation);
+		}
+
+		m_resources.clear();
+		m_passes.clear();
+		m_slots.clear();
+		m_compiled = false;
+
+		VulkanDevice* device = m_device;
+		return [device, views, images, allocations]() mutable {
+			for (VkImageView view : views)
+			{
+				vkDestroyImageView(device->getDevice(), view, nullptr);
+			}
+			for (VkImage image : images)
+			{
+				vkDestroyImage(device->getDevice(), image, nullptr);
+			}
+			for (VulkanAllocation& allocation : allocations)
+			{
+				device->getAllocator()->free(allocation);
+			}
+		};
+	}
+
+	RenderResource VulkanRenderGraph::importImage(const std::string& name, VkImage image, VkImageView view, VkImageAspectFlags aspect, uint32_t mipLevels,
+		VkImageLayout initialLayout, VkImageLayout finalLayout, VkPipelineStageFlags initialStages)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.imported = true;
+		resource.image = image;
+		resource.view = view;
+		resource.aspect = aspect;
+		resource.mipLevels = mipLevels;
+		resource.finalLayout = finalLayout;
+		resource.initial.layout = initialLayout;
+		resource.initial.writeStages = initialStages;
+		resource.state = resource.initial;
+
+		m_resources.push_back(resource);
+		return static_cast<RenderResource>(m_resources.size() - 1);
+	}
+
+	RenderResource VulkanRenderGraph::importBuffer(const std::string& name, VkBuffer buffer)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.isBuffer = true;
+		resource.imported = true;
+		resource.buffer = buffer;
+
+		m_resources.push_back(resource);
+		return static_cast<RenderResource>(m_resources.size() - 1);
+	}
+
+	RenderResource VulkanRenderGraph::createImage(const std::string& name, const RenderImageDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.desc = desc;
+		resource.aspect = desc.aspect;
+		resource.mipLevels = desc.mipLevels;
+
+		m_resources.push_back(resource);
+		return static_cast<RenderResource>(m_resources.size() - 1);
+	}
+
+	void VulkanRenderGraph::setImportedImage(RenderResource resource, VkImage image, VkImageView view)
+	{
+		Resource& imported = m_resources[resource];
+		imported.image = image;
+		imported.view = view;
+		imported.state = imported.initial;
+	}
+
+	void VulkanRenderGraph::setOutput(RenderResource resource)
+	{
+		m_resources[resource].output = true;
+	}
+
+	void VulkanRenderGraph::addPass(const std::string& name, RenderPassType type, std::function<void(RenderPassBuilder&)> setup, std::function<void(VkCommandBuffer)> execute)
+	{
+		if (m_compiled) {
+			ELOG("Render graph passes have to be added before compiling!");
+			throw std::runtime_error("Render graph passes have to be added before compiling!");
+		}
+
+		Pass pass;
+		pass.name = name;
+		pass.type = type;
+		pass.execute = std::move(execute);
+		m_passes.push_back(std::move(pass));
+
+		RenderPassBuilder builder(this, static_cast<uint32_t>(m_passes.size() - 1));
+		setup(builder);
+	}
+
+	void VulkanRenderGraph::addAccess(uint32_t pass, RenderResource resource, RenderUsage usage, bool write)
+	{
+		PassAccess access = {};
+		access.resource = resource;
+		access.write = write;
+		access.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		switch (usage)
+		{
+		case RenderUsage::ColorAttachment:
+			access.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			access.access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			access.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			break;
+		case RenderUsage::DepthAttachment:
+			access.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			access.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			access.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			break;
+		case RenderUsage::DepthRead:
+			access.stages = getShaderStages(m_passes[pass].type);
+			access.access = VK_ACCESS_SHADER_READ_BIT;
+			access.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			break;
+		case RenderUsage::SampledRead:
+			access.stages = getShaderStages(m_passes[pass].type);
+			access.access = VK_ACCESS_SHADER_READ_BIT;
+			access.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			break;
+		case RenderUsage::StorageRead:
+			access.stages = getShaderStages(m_passes[pass].type);
+			access.access = VK_ACCESS_SHADER_READ_BIT;
+			access.layout = VK_IMAGE_LAYOUT_GENERAL;
+			break;
+		case RenderUsage::StorageWrite:
+			access.stages = getShaderStages(m_passes[pass].type);
+			access.access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			access.layout = VK_IMAGE_LAYOUT_GENERAL;
+			break;
+		case RenderUsage::IndirectRead:
+			access.stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+			access.access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+			break;
+		case RenderUsage::TransferRead:
+			access.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			access.access = VK_ACCESS_TRANSFER_READ_BIT;
+			access.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			break;
+		case RenderUsage::TransferWrite:
+			access.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			access.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+			access.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			break;
+		}
+
+		if (m_resources[resource].isBuffer)
+			access.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		//Several usages of one resource in a pass become a single access, an image can only be in one layout for it
+		for (PassAccess& existing : m_passes[pass].accesses)
+		{
+			if (existing.resource != resource)
+				continue;
+
+			if (existing.layout != access.layout) {
+				ELOG("Render graph pass ", m_passes[pass].name, " uses ", m_resources[resource].name, " in two layouts!");
+				throw std::runtime_error("Render graph pass uses an image in two layouts!");
+			}
+
+			existing.stages |= access.stages;
+			existing.access |= access.access;
+			existing.write = existing.write || access.write;
+			return;
+		}
+
+		m_passes[pass].accesses.push_back(access);
+	}
+
+	void VulkanRenderGraph::compile()
+	{
+		if (m_compiled) {
+			ELOG("Render graph is already compiled!");
+			throw std::runtime_error("Render graph is already compiled!");
+		}
+
+		cullPasses();
+
+		for (uint32_t i = 0; i < m_passes.size(); i++)
+		{
+			if (!m_passes[i].live)
+				continue;
+
+			for (const PassAccess& access : m_passes[i].accesses)
+			{
+				Resource& resource = m_resources[access.resource];
+				resource.firstPass = std::min(resource.firstPass, i);
+				resource.lastPass = std::max(resource.lastPass, i);
+			}
+		}
+
+		placeTransients();
+		m_compiled = true;
+	}
+
+	void VulkanRenderGraph::cullPasses()
+	{
+		std::vector<bool> needed(m_resources.size());
+		for (size_t i = 0; i < m_resources.size(); i++)
+		{
+			needed[i] = m_resources[i].output;
+		}
+
+		//Walking back from the outputs, a pass lives if it writes something a later live pass or the frame's outputs need
+		for (size_t i = m_passes.size(); i-- > 0;)
+		{
+			Pass& pass = m_passes[i];
+			pass.live = false;
+			for (const PassAccess& access : pass.accesses)
+			{
+				if (access.write && needed[access.resource])
+					pass.live = true;
+			}
+
+			if (!pass.live) {
+				LOG("Render graph culled pass ", pass.name);
+				continue;
+			}
+
+			for (const PassAccess& access : pass.accesses)
+			{
+				needed[access.resource] = true;
+			}
+		}
+	}
+
+	void VulkanRenderGraph::placeTransients()
+	{
+		VkDevice device = m_device->getDevice();
+
+		std::vector<RenderResource> transients;
+		std::vector<VkMemoryRequirements> requirements(m_resources.size());
+
+		for (RenderResource i = 0; i < m_resources.size(); i++)
+		{
+			Resource& resource = m_resources[i];
+			if (resource.imported || resource.firstPass == UINT32_MAX)
+				continue;
+
+			VkImageCreateInfo imageInfo = {};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.extent.width = resource.desc.extent.width;
+			imageInfo.extent.height = resource.desc.extent.height;
+			imageInfo.extent.depth = 1;
+			imageInfo.mipLevels = resource.desc.mipLevels;
+			imageInfo.arrayLayers = 1;
+			imageInfo.format = resource.desc.format;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageInfo.usage = resource.desc.usage;
+			imageInfo.samples = resource.desc.samples;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+				ELOG("Failed to create image!");
+				throw std::runtime_error("Failed to create image!");
+			}
+
+			vkGetImageMemoryRequirements(device, resource.image, &requirements[i]);
+			transients.push_back(i);
+		}
+
+		//Biggest first, so the smaller images fill in behind them rather than each growing a slot
+		std::sort(transients.begin(), transients.end(), [&](RenderResource a, RenderResource b) {
+			return requirements[a].size > requirements[b].size;
+		});
+
+		VkDeviceSize requested = 0;
+		for (RenderResource i : transients)
+		{
+			Resource& resource = m_resources[i];
+			requested += requirements[i].size;
+
+			for (uint32_t s = 0; s < m_slots.size() && resource.slot == UINT32_MAX; s++)
+			{
+				MemorySlot& slot = m_slots[s];
+				if ((slot.requirements.memoryTypeBits & requirements[i].memoryTypeBits) == 0)
+					continue;
+
+				bool overlaps = false;
+				for (auto& lifetime : slot.lifetimes)
+				{
+					if (resource.firstPass <= lifetime.second && lifetime.first <= resource.lastPass)
+						overlaps = true;
+				}
+
+				if (!overlaps)
+					resource.slot = s;
+			}
+
+			if (resource.slot == UINT32_MAX)
+			{
+				m_slots.push_back(MemorySlot());
+				m_slots.back().requirements.memoryTypeBits = requirements[i].memoryTypeBits;
+				m_slots.back().requirements.alignment = 1;
+				resource.slot = static_cast<uint32_t>(m_slots.size() - 1);
+			}
+
+			MemorySlot& slot = m_slots[resource.slot];
+			slot.requirements.size = std::max(slot.requirements.size, requirements[i].size);
+			slot.requirements.alignment = std::max(slot.requirements.alignment, requirements[i].alignment);
+			slot.requirements.memoryTypeBits &= requirements[i].memoryTypeBits;
+			slot.lifetimes.push_back({ resource.firstPass, resource.lastPass });
+		}
+
+		VkDeviceSize allocated = 0;
+		for (MemorySlot& slot : m_slots)
+		{
+			uint32_t memoryType = m_device->getMemoryType(slot.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			slot.allocation = m_device->getAllocator()->allocate(slot.requirements, memoryType, AllocationKind::Optimal);
+			allocated += slot.requirements.size;
+		}
+
+		for (RenderResource i : transients)
+		{
+			Resource& resource = m_resources[i];
+			MemorySlot& slot = m_slots[resource.slot];
+
+			if (vkBindImageMemory(device, resource.image, slot.allocation.memory, slot.allocation.offset) != VK_SUCCESS) {
+				ELOG("Failed to bind image memory!");
+				throw std::runtime_error("Failed to bind image memory!");
+			}
+
+			//Views of depth stencil images only see depth, barriers still cover both aspects
+			VkImageViewCreateInfo viewInfo = {};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = resource.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.desc.format;
+			viewInfo.subresourceRange.aspectMask = (resource.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? VK_IMAGE_ASPECT_DEPTH_BIT : resource.aspect;
+			viewInfo.subresourceRange.levelCount = resource.mipLevels;
+			viewInfo.subresourceRange.layerCount = 1;
+
+			if (vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS) {
+				ELOG("Failed to create texture image view!");
+				throw std::runtime_error("Failed to create texture image view!");
+			}
+		}
+
+		static Gauge* transientBytes = Metrics::get().gauge("vengine_render_graph_transient_bytes", "Device memory held by the render graph's transient images");
+		static Gauge* aliasedBytes = Metrics::get().gauge("vengine_render_graph_aliased_bytes", "Device memory the render graph saved by aliasing transient images");
+		transientBytes->set(static_cast<int64_t>(allocated));
+		aliasedBytes->set(static_cast<int64_t>(requested - allocated));
+	}
+
+	void VulkanRenderGraph::sync(Resource& resource, const PassAccess& access, VkPipelineStageFlags& srcStages, VkPipelineStageFlags& dstStages,
+		std::vector<VkImageMemoryBarrier>& imageBarriers, std::vector<VkBufferMemoryBarrier>& bufferBarriers)
+	{
+		SyncState& state = resource.state;
+		bool transition = !resource.isBuffer && access.layout != state.layout;
+
+		VkPipelineStageFlags src = 0;
+		VkAccessFlags srcAccess = 0;
+		bool barrier = false;
+
+		if (access.write || transition)
+		{
+			//Writes and layout transitions wait on every use since the last write, reads included
+			src = state.writeStages | state.readStages;
+			srcAccess = state.writeAccess;
+			barrier = transition || src != 0;
+
+			state.writeStages = access.stages;
+			state.writeAccess = access.write ? (access.access & WRITE_ACCESS) : 0;
+			state.readStages = access.write ? 0 : access.stages;
+			state.readAccess = access.write ? 0 : access.access;
+		}
+		else
+		{
+			//Reads only wait when the last write hasn't been made visible to them yet
+			if ((access.stages & ~state.readStages) == 0 && (access.access & ~state.readAccess) == 0)
+				return;
+
+			src = state.writeStages;
+			srcAccess = state.writeAccess;
+			barrier = src != 0;
+
+			state.readStages |= access.stages;
+			state.readAccess |= access.access;
+		}
+
+		if (!barrier)
+			return;
+
+		srcStages |= src != 0 ? src : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		dstStages |= access.stages;
+
+		if (resource.isBuffer)
+		{
+			VkBufferMemoryBarrier bufferBarrier = {};
+			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferBarrier.srcAccessMask = srcAccess;
+			bufferBarrier.dstAccessMask = access.access;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = resource.buffer;
+			bufferBarrier.offset = 0;
+			bufferBarrier.size = VK_WHOLE_SIZE;
+			bufferBarriers.push_back(bufferBarrier);
+			return;
+		}
+
+		VkImageMemoryBarrier imageBarrier = {};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = srcAccess;
+		imageBarrier.dstAccessMask = access.access;
+		imageBarrier.oldLayout = state.layout;
+		imageBarrier.newLayout = access.layout;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = resource.image;
+		imageBarrier.subresourceRange.aspectMask = resource.aspect;
+		imageBarrier.subresourceRange.levelCount = resource.mipLevels;
+		imageBarrier.subresourceRange.layerCount = 1;
+		imageBarriers.push_back(imageBarrier);
+
+		state.layout = access.layout;
+	}
+
+	void VulkanRenderGraph::execute(VkCommandBuffer commandBuffer)
+	{
+		if (!m_compiled) {
+			ELOG("Render graph has to be compiled before executing!");
+			throw std::runtime_error("Render graph has to be compiled before executing!");
+		}
+
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+
+		for (uint32_t i = 0; i < m_passes.size(); i++)
+		{
+			Pass& pass = m_passes[i];
+			if (!pass.live)
+				continue;
+
+			VkPipelineStageFlags srcStages = 0;
+			VkPipelineStageFlags dstStages = 0;
+			imageBarriers.clear();
+			bufferBarriers.clear();
+
+			for (const PassAccess& access : pass.accesses)
+			{
+				Resource& resource = m_resources[access.resource];
+
+				//A transient's contents never outlive the frame, it only has to wait for the last image in its memory
+				if (!resource.imported && resource.firstPass == i)
+				{
+					MemorySlot& slot = m_slots[resource.slot];
+					resource.state = SyncState();
+					resource.state.writeStages = slot.stages;
+					resource.state.writeAccess = slot.access;
+				}
+
+				sync(resource, access, srcStages, dstStages, imageBarriers, bufferBarriers);
+			}
+
+			if (!imageBarriers.empty() || !bufferBarriers.empty())
+			{
+				vkCmdPipelineBarrier(commandBuffer,
+					srcStages, dstStages, 0,
+					0, nullptr,
+					static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+					static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+			}
+
+			//Graphics passes may run secondary command buffers, which can't inherit a statistics query on every device
+			uint32_t scope = UINT32_MAX;
+			if (m_profiler != nullptr)
+				scope = m_profiler->beginScope(commandBuffer, pass.name, pass.type == RenderPassType::Compute);
+
+			pass.execute(commandBuffer);
+
+			if (m_profiler != nullptr)
+				m_profiler->endScope(commandBuffer, scope);
+
+			for (const PassAccess& access : pass.accesses)
+			{
+				Resource& resource = m_resources[access.resource];
+				if (resource.imported || resource.lastPass != i)
+					continue;
+
+				MemorySlot& slot = m_slots[resource.slot];
+				slot.stages = resource.state.writeStages | resource.state.readStages;
+				slot.access = resource.state.writeAccess;
+			}
+		}
+
+		//Imported images are left how their owner expects them, the swapchain image ready to present
+		imageBarriers.clear();
+		VkPipelineStageFlags srcStages = 0;
+		for (Resource& resource : m_resources)
+		{
+			if (!resource.imported || resource.isBuffer || resource.firstPass == UINT32_MAX)
+				continue;
+			if (resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == resource.state.layout)
+				continue;
+
+			VkPipelineStageFlags src = resource.state.writeStages | resource.state.readStages;
+			srcStages |= src != 0 ? src : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+			VkImageMemoryBarrier imageBarrier = {};
+			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.srcAccessMask = resource.state.writeAccess;
+			imageBarrier.dstAccessMask = 0;
+			imageBarrier.oldLayout = resource.state.layout;
+			imageBarrier.newLayout = resource.finalLayout;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = resource.image;
+			imageBarrier.subresourceRange.aspectMask = resource.aspect;
+			imageBarrier.subresourceRange.levelCount = resource.mipLevels;
+			imageBarrier.subresourceRange.layerCount = 1;
+			imageBarriers.push_back(imageBarrier);
+
+			resource.state = SyncState();
+			resource.state.layout = resource.finalLayout;
+			resource.state.writeStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		}
+
+		if (!imageBarriers.empty())
+		{
+			vkCmdPipelineBarrier(commandBuffer,
+				srcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+		}
+	}
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "VulkanAllocator.h"
+
+namespace VEngine {
+
+	class VulkanDevice;
+	class VulkanGpuProfiler;
+
+	//Index of an image or buffer in a VulkanRenderGraph
+	typedef uint32_t RenderResource;
+	const static RenderResource INVALID_RENDER_RESOURCE = UINT32_MAX;
+
+	//How a pass touches a resource, each maps to the stages, access and image layout it needs
+	enum class RenderUsage {
+		ColorAttachment,	//Color or resolve attachment of the pass's render pass
+		DepthAttachment,	//Depth tested and written
+		DepthRead,			//Depth sampled in the read only layout
+		SampledRead,		//Sampled in the shader read only layout
+		StorageRead,		//Read in the general layout, storage buffers and images, or images sampled there
+		StorageWrite,		//Written, and maybe read, in the general layout
+		IndirectRead,		//Indirect draw or dispatch arguments
+		TransferRead,
+		TransferWrite
+	};
+
+	enum class RenderPassType {
+		Graphics,
+		Compute,
+		Transfer
+	};
+
+	//An image the graph creates and owns, its memory is shared with transients used in other passes
+	struct RenderImageDesc {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent = { 0, 0 };
+		uint32_t mipLevels = 1;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+		VkImageUsageFlags usage = 0;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	};
+
+	class VulkanRenderGraph;
+
+	//Handed to a pass's setup to declare what it reads and writes
+	class RenderPassBuilder
+	{
+	public:
+		void read(RenderResource resource, RenderUsage usage);
+		void write(RenderResource resource, RenderUsage usage);
+
+	private:
+		friend class VulkanRenderGraph;
+		RenderPassBuilder(VulkanRenderGraph* graph, uint32_t pass) : m_graph(graph), m_pass(pass) {};
+
+		VulkanRenderGraph* m_graph;
+		uint32_t m_pass;
+	};
+
+	/*
+	 * The frame as a list of passes that declare the images and buffers they use, instead of recording their own barriers.
+	 * compile() drops passes nothing visible depends on and places the graph's transient images, letting images whose passes
+	 * don't overlap share the same memory. execute() then records the passes in order with the barriers and layout
+	 * transitions between them worked out from the declared usages, batched into one vkCmdPipelineBarrier per pass.
+	 *
+	 * Imported resources are owned elsewhere. Their state carries over from frame to frame, so a pass reading last frame's
+	 * output is synchronized against it too, unless setImportedImage() swaps the image, as for the swapchain image.
+	 * Passes stay in the order they were added, the graph only decides what to sync and what to skip.
+	 */
+	class VulkanRenderGraph
+	{
+	public:
+		void create(VulkanDevice* device);
+		//Frees the transient images and forgets every pass and resource, the graph can be built again after
+		void destroy();
+		//Forgets the same as destroy(), handing back the freeing of the images for when no frame in flight uses them
+		std::function<void()> release();
+
+		//finalLayout is left for the image at the end of each frame, VK_IMAGE_LAYOUT_UNDEFINED keeps whatever the last pass used
+		RenderResource importImage(const std::string& name, VkImage image, VkImageView view, VkImageAspectFlags aspect, uint32_t mipLevels,
+			VkImageLayout initialLayout, VkImageLayout finalLayout, VkPipelineStageFlags initialStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		RenderResource importBuffer(const std::string& name, VkBuffer buffer);
+		RenderResource createImage(const std::string& name, const RenderImageDesc& desc);
+
+		//Swaps an imported image for this frame's, starting again from the layout and stages it was imported with
+		void setImportedImage(RenderResource resource, VkImage image, VkImageView view);
+		//Marks a resource as needed after the frame, passes not contributing to one are culled
+		void setOutput(RenderResource resource);
+
+		void addPass(const std::string& name, RenderPassType type, std::function<void(RenderPassBuilder&)> setup, std::function<void(VkCommandBuffer)> execute);
+
+		//Times every pass it executes, compute passes with their pipeline statistics
+		void setProfiler(VulkanGpuProfiler* profiler) { m_profiler = profiler; };
+
+		//After the last addPass(), transient images can be looked up from here on
+		void compile();
+		void execute(VkCommandBuffer commandBuffer);
+
+		VkImage getImage(RenderResource resource) { return m_resources[resource].image; };
+		VkImageView getView(RenderResource resource) { return m_resources[resource].view; };
+
+	private:
+		friend class RenderPassBuilder;
+
+		//What a resource's last writes and reads were, for working out the next barrier
+		struct SyncState
+		{
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags writeStages = 0;
+			VkAccessFlags writeAccess = 0;
+			//Stages and accesses already ordered after the last write
+			VkPipelineStageFlags readStages = 0;
+			VkAccessFlags readAccess = 0;
+		};
+
+		struct Resource
+		{
+			std::string name;
+			bool isBuffer = false;
+			bool imported = false;
+			bool output = false;
+
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+			uint32_t mipLevels = 1;
+
+			RenderImageDesc desc;
+			VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			SyncState initial;
+			SyncState state;
+
+			//First and last live pass using it, and the memory slot of a transient
+			uint32_t firstPass = UINT32_MAX;
+			uint32_t lastPass = 0;
+			uint32_t slot = UINT32_MAX;
+		};
+
+		struct PassAccess
+		{
+			RenderResource resource;
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			VkImageLayout layout;
+			bool write;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			RenderPassType type;
+			std::function<void(VkCommandBuffer)> execute;
+			std::vector<PassAccess> accesses;
+			bool live = false;
+		};
+
+		//Memory shared by transient images that are never used by the same passes
+		struct MemorySlot
+		{
+			VkMemoryRequirements requirements = {};
+			VulkanAllocation allocation = {};
+			std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+
+			//Last use of the slot by any of its images, the next first use waits on it
+			VkPipelineStageFlags stages = 0;
+			VkAccessFlags access = 0;
+		};
+
+		void addAccess(uint32_t pass, RenderResource resource, RenderUsage usage, bool write);
+		void cullPasses();
+		void placeTransients();
+		void sync(Resource& resource, const PassAccess& access, VkPipelineStageFlags& srcStages, VkPipelineStageFlags& dstStages,
+			std::vector<VkImageMemoryBarrier>& imageBarriers, std::vector<VkBufferMemoryBarrier>& bufferBarriers);
+
+		VulkanDevice* m_device = nullptr;
+		VulkanGpuProfiler* m_profiler = nullptr;
+		bool m_compiled = false;
+
+		std::vector<Resource> m_resources;
+		std::vector<Pass> m_passes;
+		std::vector<MemorySlot> m_slots;
+	};
+}
@@ -1,8 +1,12 @@
 #include "VulkanRenderer.h"
+#include "InputManager.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_STATIC
+#include <stb_image_write.h>
 
 namespace VEngine {
 	size_t currentFrame = 0;
-	const int MAX_FRAMES_IN_FLIGHT = 2;
 
 	static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
 		auto app = reinterpret_cast<VulkanRenderer*>(glfwGetWindowUserPointer(window));
@@ -16,154 +20,606 @@ namespace VEngine {
 		   VERTEX_COMPONENT_UV,
 		});
 
+	//Same locations as vertexLayout in the order the vertex shader names them, drawn with QUANTIZED_VERTEX_SHADER
+	const VertexLayout quantizedVertexLayout = VertexLayout({
+		   VERTEX_COMPONENT_POSITION_UNORM16,
+		   VERTEX_COMPONENT_NORMAL_OCT16,
+		   VERTEX_COMPONENT_COLOR_UNORM8,
+		   VERTEX_COMPONENT_UV_HALF,
+		});
+
 
 	void VulkanRenderer::initVulkan(int width, int height) {
 		LOG("Initializing Vulkan");
+		m_framesInFlight = std::max(1u, framesInFlight);
+		m_inputTimes.resize(m_framesInFlight);
+		m_doneTimes.resize(m_framesInFlight);
+
 		createInstance();
 		Debug::setupDebugMessenger(m_instance);
 		
-		createSurface();
+		m_surface = VK_NULL_HANDLE;
+		if (!headless)
+			createSurface();
 
 		m_device = new VulkanDevice();
-		m_device->createDevice(m_instance, &m_surface); 
+		m_device->createDevice(m_instance, &m_surface, m_physicalDeviceProperties2);
+
+		//Every mesh is loaded with the global layout, so it's chosen before the first one
+		if (quantizedVertices && !std::ifstream(QUANTIZED_VERTEX_SHADER).good()) {
+			WLOG("Quantized vertex shader not found, meshes stay in full precision!");
+			quantizedVertices = false;
+		}
+		if (quantizedVertices)
+			vertexLayout = quantizedVertexLayout;
 
 		ModelCreateInfo modelCreateInfo(glm::vec3(4.0f), glm::vec3(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 
-		mdl.loadFromFile("resources/models/cube.obj", vertexLayout, &modelCreateInfo, m_device, m_device->getGraphicsQueue());
+		mdl.loadFromFile("resources/models/cube.obj", vertexLayout, &modelCreateInfo, m_device);
 
 		m_swapChain = new VulkanSwapChain();
-		m_swapChain->createSwapChain(m_device, m_surface, (uint32_t)width, (uint32_t)height );
+		m_swapChain->setPresentMode(presentMode);
+		m_swapChain->setImageCount(swapImageCount);
+		if (headless)
+			m_swapChain->createOffscreen(m_device, (uint32_t)width, (uint32_t)height, m_framesInFlight);
+		else
+			m_swapChain->createSwapChain(m_device, m_surface, (uint32_t)width, (uint32_t)height );
 		m_swapChain->createImageViews();
 		createRenderPass();
 		createDescriptorSetLayout();
+		createBindless();
+		m_pipelines.create(m_device);
 		createGraphicsPipeline();
-		createColorResources();
 		createDepthResources();
-		m_swapChain->createFramebuffers(m_renderPass, m_depthTexture, m_colorTexture);
 		//createBuffers();
 		createUniformBuffers();
+		createCulling();
+		buildRenderGraph();
+		m_swapChain->createFramebuffers(m_renderPass, m_depthTexture.getView(), m_graph.getView(m_colorTarget));
 			
-		m_tex.loadFromFile("resources/textures/mosaic.png", VK_FORMAT_R8G8B8A8_UNORM, m_device, m_device->getTransferQueue(), VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		m_tex.loadFromFile("resources/textures/mosaic.png", VK_FORMAT_R8G8B8A8_UNORM, m_device, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		//First in the bindless array, so a model's default texture index of 0 draws with it
+		addTexture(m_tex);
 
-		createDescriptorPool();
+		createDescriptorAllocators();
 		createDescriptorSets();
-		createCommandBuffers();
+		createCommandPools();
 		createSyncObjects();
+		m_profiler.create(m_device, m_framesInFlight);
+		updateCamera();
+
+		if (headless)
+			return;
 
-		
 		GLFWwindow* window = WindowManager::get().getHandle();
 		glfwSetWindowUserPointer(window, this);
 		glfwSetFramebufferSizeCallback(WindowManager::get().getHandle(), framebufferResizeCallback);
 	}
 
-	void VulkanRenderer::updateFrame(uint32_t currentImage)
+	void VulkanRenderer::updateCamera()
 	{
 		static auto startTime = std::chrono::high_resolution_clock::now();
 
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+		if (cameraTime >= 0.0f)
+			time = cameraTime;
+
+		//m_camera.model = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	    m_camera.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		m_camera.view = glm::lookAt(glm::vec3(15.0f, 5.0f, 15.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		m_camera.proj = glm::perspective(glm::radians(45.0f), m_swapChain->getSwapChainExtent().width / (float)m_swapChain->getSwapChainExtent().height, 0.1f, 1000.0f);
+		m_camera.proj[1][1] *= -1;
+	}
 
-		UniformBufferObject ubo = {};
-		//ubo.model = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-	    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		ubo.view = glm::lookAt(glm::vec3(15.0f, 5.0f, 15.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		ubo.proj = glm::perspective(glm::radians(45.0f), m_swapChain->getSwapChainExtent().width / (float)m_swapChain->getSwapChainExtent().height, 0.1f, 1000.0f);
-		ubo.proj[1][1] *= -1;
+	void VulkanRenderer::updateFrame(uint32_t frame)
+	{
+		m_uniformBuffer.write(frame, &m_camera, sizeof(m_camera));
 
-		m_uniformBuffers[currentImage].map();
-		m_uniformBuffers[currentImage].copyTo(&ubo, sizeof(ubo));
-		m_uniformBuffers[currentImage].unmap();
+		writeDraws(frame, getViewProjection());
 	}
 
 
-	void VulkanRenderer::updateCommandBuffers() {
-		m_graphicsCommandBuffers.resize(m_swapChain->getSwapChainFramebuffers().size());
+	bool VulkanRenderer::isUploaded(Model* model)
+	{
+		return m_device->getTransferStagingBuffer()->isComplete(model->uploadSerial);
+	}
 
-		for (size_t i = 0; i < m_graphicsCommandBuffers.size(); i++) {
-			vkResetCommandBuffer(m_graphicsCommandBuffers[i], VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+	void VulkanRenderer::pushBackModel(int id, VulkanModelComponent* model)
+	{
+		if (!model->pipeline)
+			model->pipeline = m_defaultPipeline;
+		m_models.insert(std::pair<int, VulkanModelComponent*>(id, model));
 
-			VkCommandBufferBeginInfo cmdBufferBeginInfo{};
-			cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			cmdBufferBeginInfo.flags = NULL;
+		std::pair<Model*, VkPipeline*> key(model->model, model->pipeline);
+		auto found = m_batchLookup.find(key);
+		if (found == m_batchLookup.end())
+		{
+			InstanceBatch batch;
+			batch.model = model->model;
+			batch.pipeline = model->pipeline;
+			found = m_batchLookup.insert({ key, m_batches.size() }).first;
+			m_batches.push_back(std::move(batch));
+		}
 
-			vkBeginCommandBuffer(m_graphicsCommandBuffers[i], &cmdBufferBeginInfo);
+		InstanceBatch& batch = m_batches[found->second];
+		model->instanceIndex = static_cast<uint32_t>(batch.instances.size());
+		batch.instances.push_back(model);
+	}
 
-			VkRenderPassBeginInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = m_renderPass;
-			renderPassInfo.framebuffer = m_swapChain->getSwapChainFramebuffers()[i];
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = m_swapChain->getSwapChainExtent();
+	void VulkanRenderer::removeModel(int id)
+	{
+		auto found = m_models.find(id);
+		if (found == m_models.end())
+			return;
 
-			std::array<VkClearValue, 2> clearValues = {};
-			clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			clearValues[1].depthStencil = { 1.0f, 0 };
+		VulkanModelComponent* model = found->second;
+		m_models.erase(found);
 
-			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+		size_t batchIndex = m_batchLookup[std::make_pair(model->model, model->pipeline)];
+		InstanceBatch& batch = m_batches[batchIndex];
 
-			vkCmdBeginRenderPass(m_graphicsCommandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		//Swap the last instance into the hole so the batch stays packed
+		VulkanModelComponent* last = batch.instances.back();
+		batch.instances[model->instanceIndex] = last;
+		last->instanceIndex = model->instanceIndex;
+		batch.instances.pop_back();
 
-			for (std::map<int, VulkanModelComponent*>::iterator it = m_models.begin(); it != m_models.end(); ++it)
+		if (batch.instances.empty())
+		{
+			m_batchLookup.erase(std::make_pair(batch.model, batch.pipeline));
+			if (batchIndex != m_batches.size() - 1)
 			{
-				vkCmdBindDescriptorSets(m_graphicsCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSets[i], 0, nullptr);
-				draw(it->second, m_graphicsCommandBuffers[i]);
+				m_batches[batchIndex] = std::move(m_batches.back());
+				m_batchLookup[std::make_pair(m_batches[batchIndex].model, m_batches[batchIndex].pipeline)] = batchIndex;
 			}
+			m_batches.pop_back();
+		}
+	}
+
+	void VulkanRenderer::recordDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t first, size_t last)
+	{
+		//The bindless set goes with it for the whole command buffer, draws only change pipelines and buffers
+		VkDescriptorSet sets[] = { m_descriptorSets[frame], m_bindless.getSet() };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, m_bindlessEnabled ? 2 : 1, sets, 0, nullptr);
+
+		//Dynamic state isn't inherited by secondary buffers, so every buffer drawing sets its own
+		VkExtent2D extent = m_swapChain->getSwapChainExtent();
+
+		VkViewport viewport = {};
+		viewport.width = (float)extent.width;
+		viewport.height = (float)extent.height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = {};
+		scissor.extent = extent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		VkDeviceSize frameOffset = m_indirectBuffer.getFrameOffset(frame);
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+		uint32_t boundBlock = UINT32_MAX;
 
-			vkCmdEndRenderPass(m_graphicsCommandBuffers[i]);
+		VulkanGeometryPool* geometry = m_device->getGeometryPool();
+		uint32_t maxDrawCount = m_device->supportsMultiDrawIndirect() ? m_device->getProperties().limits.maxDrawIndirectCount : 1;
+		//Indirect commands need the feature for a non zero firstInstance, direct draws can always take one
+		bool indirect = m_device->supportsDrawIndirectFirstInstance();
 
-			if (vkEndCommandBuffer(m_graphicsCommandBuffers[i]) != VK_SUCCESS) {
-				ELOG("Failed to record command buffer!");
-				throw std::runtime_error("Failed to record command buffer!");
+		size_t i = first;
+		while (i < last)
+		{
+			InstanceBatch& batch = m_batches[m_drawnBatches[i]];
+
+			if (*batch.pipeline != boundPipeline)
+			{
+				boundPipeline = *batch.pipeline;
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boundPipeline);
 			}
+
+			//Meshes share the geometry pool's buffers, so they're only bound again when a mesh is in another block
+			if (batch.model->geometry.block != boundBlock)
+			{
+				boundBlock = batch.model->geometry.block;
+				geometry->bind(commandBuffer, boundBlock);
+			}
+
+			if (!indirect)
+			{
+				vkCmdDrawIndexed(commandBuffer, batch.model->indexCount, batch.instanceCount, batch.model->geometry.firstIndex, batch.model->geometry.firstVertex, batch.firstInstance);
+				i++;
+				continue;
+			}
+
+			//Drawn batches have consecutive slots, so a run sharing the pipeline and block is one indirect draw
+			uint32_t drawCount = 1;
+			while (i + drawCount < last && drawCount < maxDrawCount)
+			{
+				InstanceBatch& next = m_batches[m_drawnBatches[i + drawCount]];
+				if (*next.pipeline != boundPipeline || next.model->geometry.block != boundBlock)
+					break;
+				drawCount++;
+			}
+
+			vkCmdDrawIndexedIndirect(commandBuffer, m_indirectBuffer.getBuffer(), frameOffset + batch.drawSlot * sizeof(VkDrawIndexedIndirectCommand), drawCount, sizeof(VkDrawIndexedIndirectCommand));
+			i += drawCount;
 		}
 	}
 
-	void VulkanRenderer::createCommandBuffers() {
-		m_graphicsCommandBuffers.resize(m_swapChain->getSwapChainFramebuffers().size());
+	void VulkanRenderer::writeDraws(uint32_t frame, const glm::mat4& viewProj)
+	{
+		ObjectData* objects = static_cast<ObjectData*>(m_objectBuffer.getFrame(frame));
+		VkDrawIndexedIndirectCommand* commands = static_cast<VkDrawIndexedIndirectCommand*>(m_indirectBuffer.getFrame(frame));
+
+		bool culling = m_culling.isEnabled();
+		uint32_t* objectBatches = culling ? m_culling.getObjectBatches(frame) : nullptr;
+		CullBatch* cullBatches = culling ? m_culling.getBatches(frame) : nullptr;
+
+		uint32_t instanceCount = 0;
+		uint32_t slotCount = 0;
+		m_recordedDrawCalls = 0;
+		m_drawnBatches.clear();
+		m_recordedTriangles = 0;
+
+		//Lay the batches out back to back in the object buffer, each one's instances starting at its first instance.
+		//Only batches with something to draw get a slot, and only those are recorded this frame.
+		for (InstanceBatch& batch : m_batches)
+		{
+			batch.drawSlot = NO_DRAW_SLOT;
 
-		for (size_t i = 0; i < m_graphicsCommandBuffers.size(); i++) {
-			m_graphicsCommandBuffers[i] = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+			//Meshes still on the transfer queue wait for a later frame, as do pipelines with nothing to fall back on
+			if (!isUploaded(batch.model) || *batch.pipeline == VK_NULL_HANDLE)
+				continue;
 
-			VkRenderPassBeginInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = m_renderPass;
-			renderPassInfo.framebuffer = m_swapChain->getSwapChainFramebuffers()[i];
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = m_swapChain->getSwapChainExtent();
+			if (slotCount >= MAX_INDIRECT_DRAWS)
+			{
+				static bool warned = false;
+				if (!warned)
+				{
+					WLOG("Indirect buffer is full, batches skipped!");
+					warned = true;
+				}
+				break;
+			}
 
-			std::array<VkClearValue, 2> clearValues = {};
-			clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			clearValues[1].depthStencil = { 1.0f, 0 };
+			//Instances the CPU frustum test rejected are left out, the GPU path tests them all itself
+			ObjectData* batchObjects = objects + instanceCount;
+			uint32_t count = 0;
+			for (VulkanModelComponent* instance : batch.instances)
+			{
+				if (!culling && !instance->visible)
+					continue;
+
+				if (instanceCount + count >= MAX_OBJECTS)
+				{
+					static bool warned = false;
+					if (!warned)
+					{
+						WLOG("Object buffer is full, instances skipped!");
+						warned = true;
+					}
+					break;
+				}
+
+				batchObjects[count].model = batch.model->quantized ? instance->transform * batch.model->dequantize : instance->transform;
+				batchObjects[count].material = glm::uvec4(instance->textureIndex, 0, 0, 0);
+				count++;
+			}
 
-			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+			if (count == 0)
+				continue;
 
-			vkCmdBeginRenderPass(m_graphicsCommandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-			
-			for (std::map<int, VulkanModelComponent*>::iterator it = m_models.begin(); it != m_models.end(); ++it)
+			batch.drawSlot = slotCount++;
+			m_drawnBatches.push_back(static_cast<size_t>(&batch - m_batches.data()));
+
+			VkDrawIndexedIndirectCommand& command = commands[batch.drawSlot];
+			command.indexCount = batch.model->indexCount;
+			//The cull pass counts the visible instances up from zero
+			command.instanceCount = culling ? 0 : count;
+			command.firstIndex = batch.model->geometry.firstIndex;
+			command.vertexOffset = batch.model->geometry.firstVertex;
+			command.firstInstance = instanceCount;
+
+			batch.firstInstance = command.firstInstance;
+			batch.instanceCount = count;
+
+			if (culling)
 			{
-				vkCmdBindDescriptorSets(m_graphicsCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSets[i], 0, nullptr);
- 				draw(it->second,m_graphicsCommandBuffers[i]);
+				std::fill(objectBatches + instanceCount, objectBatches + instanceCount + count, batch.drawSlot);
+
+				CullBatch& cullBatch = cullBatches[batch.drawSlot];
+				//The object transforms of quantized meshes take positions from the unit cube they were packed into
+				cullBatch.boundsMin = batch.model->quantized ? glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) : glm::vec4(batch.model->dim.min, 1.0f);
+				cullBatch.boundsMax = batch.model->quantized ? glm::vec4(1.0f) : glm::vec4(batch.model->dim.max, 1.0f);
+				cullBatch.drawSlot = batch.drawSlot;
 			}
 
-			vkCmdEndRenderPass(m_graphicsCommandBuffers[i]);
+			instanceCount += count;
+
+			m_recordedDrawCalls++;
+			m_recordedTriangles += static_cast<uint64_t>(batch.model->indexCount / 3) * count;
+		}
+
+		m_objectBuffer.flush(frame, instanceCount * sizeof(ObjectData));
+		m_indirectBuffer.flush(frame, slotCount * sizeof(VkDrawIndexedIndirectCommand));
+
+		//With culling on the draw and triangle counts are what was submitted to the cull pass, not what survived it
+		if (culling)
+			m_culling.update(frame, viewProj, instanceCount, slotCount);
+	}
+
+	void VulkanRenderer::createCommandPools()
+	{
+		m_framePools.resize(m_framesInFlight);
+		m_frameCommandBuffers.resize(m_framesInFlight);
 
-			if (vkEndCommandBuffer(m_graphicsCommandBuffers[i]) != VK_SUCCESS) {
-				ELOG("Failed to record command buffer!");
-				throw std::runtime_error("Failed to record command buffer!");
+		//A pool per frame in flight, reset as a whole once that frame's fence says the GPU is done with it
+		for (size_t i = 0; i < m_framesInFlight; i++)
+		{
+			m_framePools[i] = m_device->createCommandPool(m_device->getGraphicsQueueFamilyIndex(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			m_frameCommandBuffers[i] = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false, 0, m_framePools[i]);
+		}
+
+		//The main thread records too, so one fewer worker than cores
+		uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+		m_recordThreads.start(std::min(MAX_RECORD_THREADS, cores) - 1);
+
+		//Command pools can't be used from two threads at once, so each recording thread gets its own for every frame in flight
+		uint32_t threadCount = m_recordThreads.getThreadCount();
+		m_threadPools.resize(m_framesInFlight);
+		m_secondaryBuffers.resize(m_framesInFlight);
+
+		for (size_t i = 0; i < m_framesInFlight; i++)
+		{
+			m_threadPools[i].resize(threadCount);
+			m_secondaryBuffers[i].resize(threadCount);
+
+			for (uint32_t t = 0; t < threadCount; t++)
+			{
+				m_threadPools[i][t] = m_device->createCommandPool(m_device->getGraphicsQueueFamilyIndex(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+				m_secondaryBuffers[i][t] = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY, false, 0, m_threadPools[i][t]);
 			}
 		}
 	}
-	
+
+	void VulkanRenderer::recordCommandBuffer(uint32_t frame, uint32_t imageIndex)
+	{
+		VkCommandBuffer commandBuffer = m_frameCommandBuffers[frame];
+		vkResetCommandPool(m_device->getDevice(), m_framePools[frame], 0);
+
+		VkCommandBufferBeginInfo cmdBufferBeginInfo{};
+		cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(commandBuffer, &cmdBufferBeginInfo);
+
+		m_recordFrame = frame;
+		m_recordImageIndex = imageIndex;
+		m_graph.setImportedImage(m_backbuffer, m_swapChain->getSwapImages()[imageIndex], m_swapChain->getSwapImageViews()[imageIndex]);
+
+		m_profiler.beginFrame(commandBuffer, frame);
+		m_graph.execute(commandBuffer);
+		m_profiler.endFrame(commandBuffer);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			ELOG("Failed to record command buffer!");
+			throw std::runtime_error("Failed to record command buffer!");
+		}
+	}
+
+	void VulkanRenderer::recordMainPass(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t imageIndex)
+	{
+		VkRenderPassBeginInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = m_renderPass;
+		renderPassInfo.framebuffer = m_swapChain->getSwapChainFramebuffers()[imageIndex];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = m_swapChain->getSwapChainExtent();
+
+		std::array<VkClearValue, 2> clearValues = {};
+		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		//Small scenes aren't worth the hand off, past that each thread records an even share of the draws
+		size_t drawCount = m_drawnBatches.size();
+		uint32_t threadCount = static_cast<uint32_t>(std::min<size_t>(m_recordThreads.getThreadCount(), drawCount / MIN_DRAWS_PER_THREAD));
+
+		if (threadCount <= 1)
+		{
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			uint32_t scope = m_profiler.beginScope(commandBuffer, "draws", true);
+			recordDraws(commandBuffer, frame, 0, drawCount);
+			m_profiler.endScope(commandBuffer, scope);
+		}
+		else
+		{
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+			m_recordThreads.run(threadCount, [&](uint32_t thread) {
+				VkCommandBuffer secondary = m_secondaryBuffers[frame][thread];
+				vkResetCommandPool(m_device->getDevice(), m_threadPools[frame][thread], 0);
+
+				VkCommandBufferInheritanceInfo inheritanceInfo = {};
+				inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+				inheritanceInfo.renderPass = m_renderPass;
+				inheritanceInfo.subpass = 0;
+				inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
+
+				VkCommandBufferBeginInfo secondaryBeginInfo = {};
+				secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+				secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+				vkBeginCommandBuffer(secondary, &secondaryBeginInfo);
+
+				size_t first = drawCount * thread / threadCount;
+				size_t last = drawCount * (thread + 1) / threadCount;
+				uint32_t scope = m_profiler.beginScope(secondary, "draws thread " + std::to_string(thread));
+				recordDraws(secondary, frame, first, last);
+				m_profiler.endScope(secondary, scope);
+
+				vkEndCommandBuffer(secondary);
+			});
+
+			vkCmdExecuteCommands(commandBuffer, threadCount, m_secondaryBuffers[frame].data());
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	void VulkanRenderer::recordReadback(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t imageIndex)
+	{
+		VkExtent2D extent = m_swapChain->getSwapChainExtent();
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = m_readbackBuffer.getFrameOffset(frame);
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { extent.width, extent.height, 1 };
+
+		vkCmdCopyImageToBuffer(commandBuffer, m_swapChain->getSwapImages()[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_readbackBuffer.getBuffer(), 1, &region);
+
+		//The fence doesn't make the copy visible to the host on its own
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = m_readbackBuffer.getBuffer();
+		barrier.offset = region.bufferOffset;
+		barrier.size = m_readbackBuffer.getFrameSize();
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr);
+	}
+
+	bool VulkanRenderer::readFrame(std::vector<uint8_t>& pixels)
+	{
+		if (!headless || !readback || m_lastSubmittedFrame < 0)
+			return false;
+
+		uint32_t frame = static_cast<uint32_t>(m_lastSubmittedFrame);
+		vkWaitForFences(m_device->getDevice(), 1, &m_inFlightFences[frame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+		const uint8_t* mapped = static_cast<const uint8_t*>(m_readbackBuffer.getFrame(frame));
+		pixels.assign(mapped, mapped + m_readbackBuffer.getFrameSize());
+		return true;
+	}
+
+	bool VulkanRenderer::saveFrame(const std::string& path)
+	{
+		std::vector<uint8_t> pixels;
+		if (!readFrame(pixels))
+			return false;
+
+		VkExtent2D extent = m_swapChain->getSwapChainExtent();
+		if (stbi_write_png(path.c_str(), static_cast<int>(extent.width), static_cast<int>(extent.height), 4, pixels.data(), static_cast<int>(extent.width * 4)) == 0) {
+			WLOG("Failed to write ", path, "!");
+			return false;
+		}
+
+		return true;
+	}
+
+	void VulkanRenderer::deferDestroy(std::function<void()> destroy, uint64_t uploadSerial)
+	{
+		m_deletionQueue.push(m_frameNumber, std::move(destroy), uploadSerial);
+	}
+
+	void VulkanRenderer::retireModel(Model* model)
+	{
+		deferDestroy([model]() {
+			model->destroy();
+			delete model;
+		}, model->uploadSerial);
+	}
+
+	void VulkanRenderer::setPresentMode(VkPresentModeKHR mode)
+	{
+		presentMode = mode;
+		m_swapChain->setPresentMode(mode);
+
+		//Picked up by the swapchain recreation after the next present
+		framebufferResized = true;
+	}
+
+	void VulkanRenderer::pollFrames()
+	{
+		for (uint32_t frame = 0; frame < m_framesInFlight; frame++)
+		{
+			if (m_inputTimes[frame] == std::chrono::steady_clock::time_point() || m_doneTimes[frame] != std::chrono::steady_clock::time_point())
+				continue;
+
+			if (vkGetFenceStatus(m_device->getDevice(), m_inFlightFences[frame]) == VK_SUCCESS)
+				m_doneTimes[frame] = std::chrono::steady_clock::now();
+		}
+	}
+
+	void VulkanRenderer::waitForFrame(uint32_t frame)
+	{
+		vkWaitForFences(m_device->getDevice(), 1, &m_inFlightFences[frame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+		if (m_inputTimes[frame] == std::chrono::steady_clock::time_point())
+			return;
+
+		//Not seen by a poll, so it finished while blocked here or at most since the last poll
+		if (m_doneTimes[frame] == std::chrono::steady_clock::time_point())
+			m_doneTimes[frame] = std::chrono::steady_clock::now();
+
+		static Histogram* inputLatency = Metrics::get().histogram("vengine_input_latency_ms", { 4.0, 8.0, 16.7, 25.0, 33.3, 50.0, 66.7, 100.0 }, "Time from polling input to the GPU finishing the frame drawn after it");
+		inputLatency->observe(std::chrono::duration<double, std::milli>(m_doneTimes[frame] - m_inputTimes[frame]).count());
+		m_inputTimes[frame] = std::chrono::steady_clock::time_point();
+		m_doneTimes[frame] = std::chrono::steady_clock::time_point();
+	}
+
+	void VulkanRenderer::beginFrame()
+	{
+		pollFrames();
+		if (!lowLatency)
+			return;
+
+		//With nothing left on the GPU, input is read and the frame simulated and recorded as late as they can be
+		for (uint32_t frame = 0; frame < m_framesInFlight; frame++)
+			waitForFrame(frame);
+		m_framesWaited = true;
+	}
 
 	void VulkanRenderer::drawFrame()
 	{
-		vkWaitForFences(m_device->getDevice(), 1, &m_inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+		//beginFrame has already waited on every frame in flight in low latency mode
+		pollFrames();
+		if (!m_framesWaited)
+			waitForFrame(static_cast<uint32_t>(currentFrame));
+		m_framesWaited = false;
+		m_device->reclaimUploads();
+
+		//This frame's fence covers every frame up to m_framesInFlight ago
+		if (m_frameNumber >= m_framesInFlight)
+			m_deletionQueue.flush(m_frameNumber - m_framesInFlight, m_device->getTransferStagingBuffer());
+
+		static Gauge* pendingDeletions = Metrics::get().gauge("vengine_pending_deletions", "Resources waiting on frames in flight before being destroyed");
+		pendingDeletions->set(static_cast<int64_t>(m_deletionQueue.size()));
+
+		//The fence has passed, so the sets this frame in flight handed out last time are free again
+		m_frameDescriptors[currentFrame].reset();
+
+		//Pipelines finished compiling since last frame replace their fallbacks before anything records
+		m_pipelines.update();
 
 		/*Get the next image in the swap chain to render too*/
-		uint32_t imageIndex;
-		VkResult result = vkAcquireNextImageKHR(m_device->getDevice(), m_swapChain->getSwapChain(), std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		uint32_t imageIndex = static_cast<uint32_t>(currentFrame);
+		VkResult result = VK_SUCCESS;
+		//Offscreen images are one per frame in flight, the fence just waited on means this one is free
+		if (!headless)
+			result = vkAcquireNextImageKHR(m_device->getDevice(), m_swapChain->getSwapChain(), std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
 		/*If image out of date, from resizing for example, then recreate the swapchain. */
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -175,24 +631,29 @@ namespace VEngine {
 			throw std::runtime_error("Failed to acquire swap chain image!");
 		}
 
-		updateFrame(imageIndex);
+		uint32_t frame = static_cast<uint32_t>(currentFrame);
+		updateFrame(frame);
+		recordCommandBuffer(frame, imageIndex);
 
 		VkSubmitInfo submitInfo = {};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
 		VkSemaphore waitSemaphores[] = { m_imageAvailableSemaphores[currentFrame] };
 		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.waitSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
 
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &m_graphicsCommandBuffers[imageIndex];
+		submitInfo.pCommandBuffers = &m_frameCommandBuffers[frame];
 
 		VkSemaphore signalSemaphores[] = { m_renderFinishedSemaphores[currentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.signalSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
+		//Uploads recorded since the last frame go first on the same queue
+		m_device->submitUploads();
+
 		vkResetFences(m_device->getDevice(), 1, &m_inFlightFences[currentFrame]);
 
 		if (vkQueueSubmit(m_device->getGraphicsQueue(), 1, &submitInfo, m_inFlightFences[currentFrame]) != VK_SUCCESS) {
@@ -200,6 +661,23 @@ namespace VEngine {
 			throw std::runtime_error("Failed to submit draw command buffer!");
 		}
 
+		static Counter* drawCalls = Metrics::get().counter("vengine_draw_calls_total", "Draw calls submitted");
+		static Counter* triangles = Metrics::get().counter("vengine_triangles_total", "Triangles submitted");
+		static Gauge* frameDrawCalls = Metrics::get().gauge("vengine_frame_draw_calls", "Draw calls in the last submitted frame");
+		drawCalls->add(m_recordedDrawCalls);
+		triangles->add(static_cast<int64_t>(m_recordedTriangles));
+		frameDrawCalls->set(m_recordedDrawCalls);
+
+		m_lastSubmittedFrame = static_cast<int64_t>(currentFrame);
+		m_inputTimes[currentFrame] = InputManager::getPollTime();
+
+		if (headless)
+		{
+			currentFrame = (currentFrame + 1) % m_framesInFlight;
+			m_frameNumber++;
+			return;
+		}
+
 		VkPresentInfoKHR presentInfo = {};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -223,7 +701,8 @@ namespace VEngine {
 			throw std::runtime_error("Failed to present swap chain image!");
 		}
 
-		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		currentFrame = (currentFrame + 1) % m_framesInFlight;
+		m_frameNumber++;
 	}
 
 	void VulkanRenderer::createBuffers() {
@@ -243,55 +722,190 @@ namespace VEngine {
 
 	void VulkanRenderer::createUniformBuffers()
 	{
-		VkDeviceSize uniformBufferSize = sizeof(UniformBufferObject);
-		m_uniformBuffers.resize(m_swapChain->getSwapImages().size());
-
-		for (size_t i = 0; i < m_swapChain->getSwapImages().size(); i++) {
-			m_device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_uniformBuffers[i], uniformBufferSize);
+		//One slice per frame in flight, mapped for the lifetime of the swap chain
+		m_uniformBuffer.create(m_device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(UniformBufferObject), m_framesInFlight, coherentUniforms);
+		m_objectBuffer.create(m_device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(ObjectData) * MAX_OBJECTS, m_framesInFlight, coherentUniforms);
+		m_indirectBuffer.create(m_device, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(VkDrawIndexedIndirectCommand) * MAX_INDIRECT_DRAWS, m_framesInFlight, coherentUniforms);
+		m_visibleBuffer.create(m_device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * MAX_OBJECTS, m_framesInFlight, coherentUniforms);
+
+		//Always coherent, frames are read on the host straight after their fence
+		if (headless && readback)
+		{
+			VkExtent2D extent = m_swapChain->getSwapChainExtent();
+			m_readbackBuffer.create(m_device, VK_BUFFER_USAGE_TRANSFER_DST_BIT, static_cast<VkDeviceSize>(extent.width) * extent.height * 4, m_framesInFlight, true);
 		}
-
 	}
 
-	void VulkanRenderer::createColorResources() {
-		VkFormat colorFormat = m_swapChain->getSwapChainImageFormat();
+	void VulkanRenderer::createCulling()
+	{
+		uint32_t frameCount = m_framesInFlight;
 
-		m_colorTexture.setDevice(m_device);
-		m_colorTexture.createImage(m_swapChain->getSwapChainExtent().width, m_swapChain->getSwapChainExtent().height, 1, m_device->getMsaaSamples(), colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		m_colorTexture.getView() = m_colorTexture.createImageView(m_colorTexture.getImage(), colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+		if (m_culling.create(m_device, frameCount, m_swapChain->getSwapChainExtent(), m_depthTexture.getView(), m_depthFormat, m_device->getMsaaSamples(), &m_objectBuffer, &m_indirectBuffer, &m_visibleBuffer))
+			return;
 
-		m_colorTexture.transitionImageLayout(m_colorTexture.getImage(), colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
+		//Without the cull pass every instance is drawn, so each one maps straight to its own object
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			uint32_t* visible = static_cast<uint32_t*>(m_visibleBuffer.getFrame(frame));
+			for (uint32_t i = 0; i < MAX_OBJECTS; i++)
+			{
+				visible[i] = i;
+			}
+			m_visibleBuffer.flush(frame);
+		}
 	}
 
 	void VulkanRenderer::createDepthResources()
 	{
 		m_depthFormat = m_device->findDepthFormat();
 		m_depthTexture.setDevice(m_device);
-		m_depthTexture.createImage(m_swapChain->getSwapChainExtent().width, m_swapChain->getSwapChainExtent().height, 1, m_device->getMsaaSamples(), m_depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		m_depthTexture.createImage(m_swapChain->getSwapChainExtent().width, m_swapChain->getSwapChainExtent().height, 1, m_device->getMsaaSamples(), m_depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 		m_depthTexture.getView() = m_depthTexture.createImageView(m_depthTexture.getImage(), m_depthFormat, 1, VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+
+	void VulkanRenderer::buildRenderGraph()
+	{
+		VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (m_device->hasStencilComponent(m_depthFormat))
+			depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+		m_graph.create(m_device);
+		m_graph.setProfiler(&m_profiler);
+
+		//The swapchain image is swapped in every frame, it's waited for at color output by the acquire semaphore.
+		//Offscreen images aren't presented, they're left as the last pass had them
+		m_backbuffer = m_graph.importImage("backbuffer", VK_NULL_HANDLE, VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, 1,
+			VK_IMAGE_LAYOUT_UNDEFINED, headless ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		m_graph.setOutput(m_backbuffer);
+
+		RenderResource depth = m_graph.importImage("depth", m_depthTexture.getImage(), m_depthTexture.getView(), depthAspect, 1,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED);
+		RenderResource indirect = m_graph.importBuffer("indirect", m_indirectBuffer.getBuffer());
+		RenderResource visible = m_graph.importBuffer("visible", m_visibleBuffer.getBuffer());
+
+		RenderImageDesc colorDesc;
+		colorDesc.format = m_swapChain->getSwapChainImageFormat();
+		colorDesc.extent = m_swapChain->getSwapChainExtent();
+		colorDesc.samples = m_device->getMsaaSamples();
+		colorDesc.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		m_colorTarget = m_graph.createImage("color", colorDesc);
+
+		//The pyramid is read by the next frame's cull, so it's an output even though nothing after it in the frame reads it
+		RenderResource pyramid = INVALID_RENDER_RESOURCE;
+		if (m_culling.isEnabled())
+		{
+			pyramid = m_graph.importImage("depthPyramid", m_culling.getPyramid(), VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, m_culling.getPyramidLevelCount(),
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED);
+			m_graph.setOutput(pyramid);
+
+			m_graph.addPass("cull", RenderPassType::Compute, [&](RenderPassBuilder& builder) {
+				builder.read(pyramid, RenderUsage::StorageRead);
+				builder.write(indirect, RenderUsage::StorageWrite);
+				builder.write(visible, RenderUsage::StorageWrite);
+			}, [this](VkCommandBuffer commandBuffer) {
+				m_culling.cull(commandBuffer, m_recordFrame);
+			});
+		}
+
+		m_graph.addPass("main", RenderPassType::Graphics, [&](RenderPassBuilder& builder) {
+			builder.write(m_colorTarget, RenderUsage::ColorAttachment);
+			builder.write(depth, RenderUsage::DepthAttachment);
+			builder.write(m_backbuffer, RenderUsage::ColorAttachment);
+			builder.read(indirect, RenderUsage::IndirectRead);
+			builder.read(visible, RenderUsage::StorageRead);
+		}, [this](VkCommandBuffer commandBuffer) {
+			recordMainPass(commandBuffer, m_recordFrame, m_recordImageIndex);
+		});
 
-		m_depthTexture.transitionImageLayout(m_depthTexture.getImage(), m_depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+		if (m_culling.isEnabled())
+		{
+			m_graph.addPass("depthPyramid", RenderPassType::Compute, [&](RenderPassBuilder& builder) {
+				builder.read(depth, RenderUsage::DepthRead);
+				builder.write(pyramid, RenderUsage::StorageWrite);
+			}, [this](VkCommandBuffer commandBuffer) {
+				m_culling.buildDepthPyramid(commandBuffer);
+			});
+		}
+
+		if (headless && readback)
+		{
+			RenderResource readbackBuffer = m_graph.importBuffer("readback", m_readbackBuffer.getBuffer());
+			m_graph.setOutput(readbackBuffer);
+
+			m_graph.addPass("readback", RenderPassType::Transfer, [&](RenderPassBuilder& builder) {
+				builder.read(m_backbuffer, RenderUsage::TransferRead);
+				builder.write(readbackBuffer, RenderUsage::TransferWrite);
+			}, [this](VkCommandBuffer commandBuffer) {
+				recordReadback(commandBuffer, m_recordFrame, m_recordImageIndex);
+			});
+		}
+
+		m_graph.compile();
 	}
 
-	void VulkanRenderer::createDescriptorPool()
+	void VulkanRenderer::createBindless()
 	{
-		std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(m_swapChain->getSwapImages().size());
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(m_swapChain->getSwapImages().size());
+		m_bindlessEnabled = false;
+		if (!m_device->supportsDescriptorIndexing())
+			return;
 
-		VkDescriptorPoolCreateInfo poolInfo = {};
-		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(m_swapChain->getSwapImages().size());
+		if (!std::ifstream(BINDLESS_FRAGMENT_SHADER).good()) {
+			WLOG("Bindless fragment shader not found, textures stay bound one at a time!");
+			return;
+		}
+
+		m_bindless.create(m_device);
+		m_bindlessEnabled = true;
+	}
+
+	uint32_t VulkanRenderer::addTexture(Texture& texture)
+	{
+		if (!m_bindlessEnabled)
+			return 0;
+
+		return m_bindless.addTexture(texture.getView(), texture.getSampler());
+	}
+
+	void VulkanRenderer::releaseTexture(uint32_t index)
+	{
+		if (!m_bindlessEnabled)
+			return;
+
+		//Frames in flight may still sample the slot, so it's only reused once they're done
+		deferDestroy([this, index]() { m_bindless.releaseTexture(index); });
+	}
+
+	void VulkanRenderer::createDescriptorAllocators()
+	{
+		m_descriptors.create(m_device->getDevice());
 
-		if (vkCreateDescriptorPool(m_device->getDevice(), &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS) {
-			ELOG("Failed to create descriptor pool!");
-			throw std::runtime_error("Failed to create descriptor pool!");
+		m_frameDescriptors.resize(m_framesInFlight);
+		for (DescriptorAllocator& allocator : m_frameDescriptors)
+		{
+			allocator.create(m_device->getDevice());
 		}
 	}
 
+	VkDescriptorSet VulkanRenderer::allocateSet(VkDescriptorSetLayout layout)
+	{
+		VkDescriptorSet set;
+		if (!m_descriptors.allocate(layout, &set)) {
+			ELOG("Failed to allocate descriptor sets!");
+			throw std::runtime_error("Failed to allocate descriptor sets!");
+		}
+		return set;
+	}
+
+	VkDescriptorSet VulkanRenderer::allocateFrameSet(VkDescriptorSetLayout layout)
+	{
+		VkDescriptorSet set;
+		if (!m_frameDescriptors[currentFrame].allocate(layout, &set)) {
+			ELOG("Failed to allocate descriptor sets!");
+			throw std::runtime_error("Failed to allocate descriptor sets!");
+		}
+		return set;
+	}
+
 	void VulkanRenderer::createDescriptorSetLayout()
 	{
 		VkDescriptorSetLayoutBinding uboLayoutBinding = {};
@@ -308,45 +922,46 @@ namespace VEngine {
 		samplerLayoutBinding.pImmutableSamplers = nullptr;
 		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		//Add all the descriptor sets together
-		std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
-		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-		layoutInfo.pBindings = bindings.data();
+		VkDescriptorSetLayoutBinding objectLayoutBinding = {};
+		objectLayoutBinding.binding = 2;
+		objectLayoutBinding.descriptorCount = 1;
+		objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		objectLayoutBinding.pImmutableSamplers = nullptr;
+		objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-		if (vkCreateDescriptorSetLayout(m_device->getDevice(), &layoutInfo, nullptr, &m_descriptorSetLayout) != VK_SUCCESS) {
-			ELOG("Failed to create descriptor set layout!");
-			throw std::runtime_error("Failed to create descriptor set layout!");
-		}
+		VkDescriptorSetLayoutBinding visibleLayoutBinding = {};
+		visibleLayoutBinding.binding = 3;
+		visibleLayoutBinding.descriptorCount = 1;
+		visibleLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		visibleLayoutBinding.pImmutableSamplers = nullptr;
+		visibleLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		//Add all the descriptor sets together
+		m_descriptorSetLayout = m_device->getLayoutCache()->getLayout({ uboLayoutBinding, samplerLayoutBinding, objectLayoutBinding, visibleLayoutBinding });
 	}
 
 	void VulkanRenderer::createDescriptorSets() {
-		std::vector<VkDescriptorSetLayout> layouts(m_swapChain->getSwapImages().size(), m_descriptorSetLayout);
-		VkDescriptorSetAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = m_descriptorPool;
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(m_swapChain->getSwapImages().size());
-		allocInfo.pSetLayouts = layouts.data();
-
-		m_descriptorSets.resize(m_swapChain->getSwapImages().size());
-		if (vkAllocateDescriptorSets(m_device->getDevice(), &allocInfo, m_descriptorSets.data()) != VK_SUCCESS) {
-			ELOG("Failed to allocate descriptor sets!");
-			throw std::runtime_error("Failed to allocate descriptor sets!");
+		m_descriptorSets.resize(m_framesInFlight);
+		for (size_t i = 0; i < m_framesInFlight; i++) {
+			m_descriptorSets[i] = allocateSet(m_descriptorSetLayout);
 		}
 
-		for (size_t i = 0; i < m_swapChain->getSwapImages().size(); i++) {
-			VkDescriptorBufferInfo bufferInfo = {};
-			bufferInfo.buffer = m_uniformBuffers[i].getBuffer();
-			bufferInfo.offset = 0;
-			bufferInfo.range = sizeof(UniformBufferObject);
+		writeDescriptorSets();
+	}
+
+	//Points the sets at the current buffers, a resize rewrites them instead of allocating new ones
+	void VulkanRenderer::writeDescriptorSets() {
+		for (size_t i = 0; i < m_framesInFlight; i++) {
+			VkDescriptorBufferInfo bufferInfo = m_uniformBuffer.getDescriptor(static_cast<uint32_t>(i));
+			VkDescriptorBufferInfo objectInfo = m_objectBuffer.getDescriptor(static_cast<uint32_t>(i));
+			VkDescriptorBufferInfo visibleInfo = m_visibleBuffer.getDescriptor(static_cast<uint32_t>(i));
 
 			VkDescriptorImageInfo imageInfo = {};
 			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 			imageInfo.imageView = m_tex.getView();
 			imageInfo.sampler = m_tex.getSampler();
 
-			std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+			std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
 
 			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 			descriptorWrites[0].dstSet = m_descriptorSets[i];
@@ -364,15 +979,31 @@ namespace VEngine {
 			descriptorWrites[1].descriptorCount = 1;
 			descriptorWrites[1].pImageInfo = &imageInfo;
 
+			descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[2].dstSet = m_descriptorSets[i];
+			descriptorWrites[2].dstBinding = 2;
+			descriptorWrites[2].dstArrayElement = 0;
+			descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[2].descriptorCount = 1;
+			descriptorWrites[2].pBufferInfo = &objectInfo;
+
+			descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[3].dstSet = m_descriptorSets[i];
+			descriptorWrites[3].dstBinding = 3;
+			descriptorWrites[3].dstArrayElement = 0;
+			descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[3].descriptorCount = 1;
+			descriptorWrites[3].pBufferInfo = &visibleInfo;
+
 
 			vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 		}
 	}
 
 	void VulkanRenderer::createSyncObjects() {
-		m_imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		m_renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		m_inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+		m_imageAvailableSemaphores.resize(m_framesInFlight);
+		m_renderFinishedSemaphores.resize(m_framesInFlight);
+		m_inFlightFences.resize(m_framesInFlight);
 
 		VkSemaphoreCreateInfo semaphoreInfo = {};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -381,7 +1012,7 @@ namespace VEngine {
 		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		for (size_t i = 0; i < m_framesInFlight; i++) {
 			if (vkCreateSemaphore(m_device->getDevice(), &semaphoreInfo, nullptr, &m_imageAvailableSemaphores[i]) != VK_SUCCESS ||
 				vkCreateSemaphore(m_device->getDevice(), &semaphoreInfo, nullptr, &m_renderFinishedSemaphores[i]) != VK_SUCCESS ||
 				vkCreateFence(m_device->getDevice(), &fenceInfo, nullptr, &m_inFlightFences[i]) != VK_SUCCESS) {
@@ -407,7 +1038,8 @@ namespace VEngine {
 		depthAttachment.format = m_device->findDepthFormat();
 		depthAttachment.samples = m_device->getMsaaSamples();
 		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		//Kept for the depth pyramid the next frame's occlusion culling reads
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -421,7 +1053,8 @@ namespace VEngine {
 		colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		//The render graph moves the swapchain image to the present layout after the frame's last pass
+		colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 		VkAttachmentReference colorAttachmentRef = {};
 		colorAttachmentRef.attachment = 0;
@@ -466,136 +1099,39 @@ namespace VEngine {
 		}
 	}
 
-	void VulkanRenderer::createGraphicsPipeline()
+	PipelineDesc VulkanRenderer::getDefaultPipelineDesc()
 	{
-		auto vertShaderCode = readFile("resources/shaders/vert.spv");
-		auto fragShaderCode = readFile("resources/shaders/frag.spv");
-
-		VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-		VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-		VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertShaderStageInfo.module = vertShaderModule;
-		vertShaderStageInfo.pName = "main";
-
-		VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragShaderStageInfo.module = fragShaderModule;
-		fragShaderStageInfo.pName = "main";
-
-		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-		auto bindingDescription = Vertex::getBindingDescription();
-		auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.width = (float)m_swapChain->getSwapChainExtent().width;
-		viewport.height = (float)m_swapChain->getSwapChainExtent().height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
+		PipelineDesc desc;
+		desc.vertexShader = quantizedVertices ? QUANTIZED_VERTEX_SHADER : "resources/shaders/vert.spv";
+		desc.fragmentShader = m_bindlessEnabled ? BINDLESS_FRAGMENT_SHADER : "resources/shaders/frag.spv";
+		desc.vertexLayout = vertexLayout;
+		desc.renderPass = m_renderPass;
+		desc.layout = m_pipelineLayout;
+		desc.samples = m_device->getMsaaSamples();
+
+		return desc;
+	}
 
-		VkRect2D scissor = {};
-		scissor.offset = { 0, 0 };
-		scissor.extent = m_swapChain->getSwapChainExtent();
-
-		VkPipelineViewportStateCreateInfo viewportState = {};
-		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
-		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
-
-		VkPipelineRasterizationStateCreateInfo rasterizer = {};
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_NONE;
-		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-		rasterizer.depthBiasEnable = VK_FALSE;
-
-		VkPipelineMultisampleStateCreateInfo multisampling = {};
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.minSampleShading = .0f;
-		multisampling.rasterizationSamples = m_device->getMsaaSamples();
-
-		VkPipelineDepthStencilStateCreateInfo depthStencil = {};
-		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthStencil.depthTestEnable = VK_TRUE;
-		depthStencil.depthWriteEnable = VK_TRUE;
-		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-		depthStencil.depthBoundsTestEnable = VK_FALSE;
-		depthStencil.stencilTestEnable = VK_FALSE;
-
-		VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
-
-		VkPipelineColorBlendStateCreateInfo colorBlending = {};
-		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlending.logicOpEnable = VK_FALSE;
-		colorBlending.logicOp = VK_LOGIC_OP_COPY;
-		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
-		colorBlending.blendConstants[0] = 0.0f;
-		colorBlending.blendConstants[1] = 0.0f;
-		colorBlending.blendConstants[2] = 0.0f;
-		colorBlending.blendConstants[3] = 0.0f;
+	VkPipeline* VulkanRenderer::requestPipeline(const PipelineDesc& desc)
+	{
+		return m_pipelines.request(desc, m_defaultPipeline);
+	}
 
+	void VulkanRenderer::createGraphicsPipeline()
+	{
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
-
-
+		VkDescriptorSetLayout setLayouts[] = { m_descriptorSetLayout, m_bindless.getLayout() };
+		pipelineLayoutInfo.setLayoutCount = m_bindlessEnabled ? 2 : 1;
+		pipelineLayoutInfo.pSetLayouts = setLayouts;
 
 		if (vkCreatePipelineLayout(m_device->getDevice(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
 			ELOG("Failed to create pipeline layout!");
 			throw std::runtime_error("Failed to create pipeline layout!");
 		}
 
-		VkGraphicsPipelineCreateInfo pipelineInfo = {};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
-		pipelineInfo.pVertexInputState = &vertexInputInfo;
-		pipelineInfo.pInputAssemblyState = &inputAssembly;
-		pipelineInfo.pViewportState = &viewportState;
-		pipelineInfo.pRasterizationState = &rasterizer;
-		pipelineInfo.pMultisampleState = &multisampling;
-		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.layout = m_pipelineLayout;
-		pipelineInfo.renderPass = m_renderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-		pipelineInfo.pDepthStencilState = &depthStencil;
-
-		if (vkCreateGraphicsPipelines(m_device->getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS) {
-			ELOG("Failed to create graphics pipeline!");
-			throw std::runtime_error("Failed to create graphics pipeline!");
-		}
-
-
-		vkDestroyShaderModule(m_device->getDevice(), fragShaderModule, nullptr);
-		vkDestroyShaderModule(m_device->getDevice(), vertShaderModule, nullptr);
+		//Everything else is compiled in the background and draws with this until it's ready
+		m_defaultPipeline = m_pipelines.requestNow(getDefaultPipelineDesc());
 	}
 
 	VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code) {
@@ -621,16 +1157,34 @@ namespace VEngine {
 	}
 	   	 
 	std::vector<const char*> VulkanRenderer::getRequiredExtensions() {
+		//Headless there's no window, and so no surface extensions
 		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		const char** glfwExtensions = nullptr;
+		if (!headless)
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		std::vector<const char*> extensions;
+		if (glfwExtensions != nullptr)
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
 
 		if (enableValidationLayers) {
 			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		}
 
+		//Lets the device look for descriptor indexing on a 1.0 instance
+		uint32_t availableCount = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &availableCount, nullptr);
+		std::vector<VkExtensionProperties> available(availableCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &availableCount, available.data());
+
+		m_physicalDeviceProperties2 = false;
+		for (const VkExtensionProperties& extension : available) {
+			if (strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+				extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+				m_physicalDeviceProperties2 = true;
+			}
+		}
+
 		return extensions;
 	}
 	
@@ -648,17 +1202,9 @@ namespace VEngine {
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.apiVersion = VK_API_VERSION_1_0;
 
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-
-
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
 		VkInstanceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 		createInfo.pApplicationInfo = &appInfo;
-		createInfo.enabledExtensionCount = glfwExtensionCount;
-		createInfo.ppEnabledExtensionNames = glfwExtensions;
 		
 		auto extensions = getRequiredExtensions();
 		createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
@@ -692,59 +1238,103 @@ namespace VEngine {
 			glfwGetFramebufferSize(window, &width, &height);
 			glfwWaitEvents();
 		}
-		vkDeviceWaitIdle(m_device->getDevice());
-
-		cleanupSwapChain();
+		//Nothing is waited on, frames in flight and the presentation engine may still use what's sized to the old window.
+		//Only that is made again, and the old objects go through the deletion queue. Buffers, descriptor sets and culling pipelines are kept
+		VkFormat oldFormat = m_swapChain->getSwapChainImageFormat();
+		Texture2D oldDepthTexture = m_depthTexture;
+		std::function<void()> releaseGraph = m_graph.release();
+		std::function<void()> releaseSwapChain = m_swapChain->recreate(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+
+		//A resize keeps the render pass and pipelines, they only have to change with the surface format
+		std::function<void()> releasePipelines = []() {};
+		VkRenderPass oldRenderPass = VK_NULL_HANDLE;
+		if (m_swapChain->getSwapChainImageFormat() != oldFormat) {
+			oldRenderPass = m_renderPass;
+			createRenderPass();
+			releasePipelines = m_pipelines.recreate(oldRenderPass, m_renderPass);
+		}
 
-		m_swapChain->createSwapChain(m_device,m_surface, m_swapChain->getWidth(), m_swapChain->getHeight());
-		m_swapChain->createImageViews();
-		createRenderPass();
-		createGraphicsPipeline();
-		createColorResources();
 		createDepthResources();
-		m_swapChain->createFramebuffers(m_renderPass, m_depthTexture, m_colorTexture);
-		createUniformBuffers();
-		createDescriptorPool();
-		createDescriptorSets();
-		createCommandBuffers();
+		std::function<void()> releasePyramid = m_culling.resize(m_swapChain->getSwapChainExtent(), m_depthTexture.getView());
+
+		VkDevice device = m_device->getDevice();
+		deferDestroy([device, oldDepthTexture, oldRenderPass, releaseGraph, releaseSwapChain, releasePipelines, releasePyramid]() mutable {
+			releaseSwapChain();
+			releaseGraph();
+			releasePyramid();
+			oldDepthTexture.destroy();
+			releasePipelines();
+			if (oldRenderPass != VK_NULL_HANDLE)
+				vkDestroyRenderPass(device, oldRenderPass, nullptr);
+		});
+
+		buildRenderGraph();
+		m_swapChain->createFramebuffers(m_renderPass, m_depthTexture.getView(), m_graph.getView(m_colorTarget));
 	}
 
 	void VulkanRenderer::cleanupSwapChain()
 	{
-		m_colorTexture.destroy();
-		m_depthTexture.destroy();	
-
-		m_swapChain->destroy();
-
-		vkFreeCommandBuffers(m_device->getDevice(), m_device->getGraphicsCommandPool(), static_cast<uint32_t>(m_graphicsCommandBuffers.size()), m_graphicsCommandBuffers.data());
-		
-		for (size_t i = 0; i < m_swapChain->getSwapImages().size(); i++) {
-			m_uniformBuffers[i].destroy();
-		}
+		m_graph.destroy();
+		m_depthTexture.destroy();
+		m_swapChain->destroyFramebuffers();
+	}
 
-		vkDestroyPipeline(m_device->getDevice(), m_graphicsPipeline, nullptr);
+	void VulkanRenderer::destroyUniformBuffers()
+	{
+		m_uniformBuffer.destroy();
+		m_objectBuffer.destroy();
+		m_indirectBuffer.destroy();
+		m_visibleBuffer.destroy();
+		if (headless && readback)
+			m_readbackBuffer.destroy();
+		m_culling.destroy();
+	}
+	
+	void VulkanRenderer::destroyGraphicsPipeline()
+	{
+		m_pipelines.destroy();
 		vkDestroyPipelineLayout(m_device->getDevice(), m_pipelineLayout, nullptr);
 		vkDestroyRenderPass(m_device->getDevice(), m_renderPass, nullptr);
-
-		vkDestroyDescriptorPool(m_device->getDevice(), m_descriptorPool, nullptr);
 	}
-	
+
 	void VulkanRenderer::cleanup()
 	{
 		vkDeviceWaitIdle(m_device->getDevice());
 
 		m_tex.destroy();
 		mdl.destroy();
-		cleanupSwapChain();	
+		m_deletionQueue.flushAll();
+		cleanupSwapChain();
+		m_swapChain->destroy();
+		destroyUniformBuffers();
+		destroyGraphicsPipeline();
+
+		m_recordThreads.stop();
+
+		for (size_t i = 0; i < m_framesInFlight; i++)
+		{
+			vkDestroyCommandPool(m_device->getDevice(), m_framePools[i], nullptr);
+
+			for (VkCommandPool pool : m_threadPools[i])
+			{
+				vkDestroyCommandPool(m_device->getDevice(), pool, nullptr);
+			}
+		}
 
 		m_stagingBuffer.destroy();
 	//	m_vertexBuffer.destroy();
 		//m_indexBuffer.destroy();
 
-		vkDestroyDescriptorSetLayout(m_device->getDevice(), m_descriptorSetLayout, nullptr);
-		
+		m_descriptors.destroy();
+		for (DescriptorAllocator& allocator : m_frameDescriptors)
+		{
+			allocator.destroy();
+		}
+		m_bindless.destroy();
+		m_profiler.destroy();
+
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (size_t i = 0; i < m_framesInFlight; i++)
 		{
 			vkDestroySemaphore(m_device->getDevice(), m_renderFinishedSemaphores[i], nullptr);
 			vkDestroySemaphore(m_device->getDevice(), m_imageAvailableSemaphores[i], nullptr);
@@ -11,13 +11,23 @@
 #include <cstring>
 #include <cstdlib>
 #include <array>
+#include <algorithm>
 
 #include "VulkanDebug.h"
 #include "VulkanDevice.h"
 #include "VulkanSwapChain.h"
 #include "VulkanBuffer.h"
+#include "VulkanPerFrameBuffer.h"
 #include "VulkanTexture.h"
 #include "VulkanModel.h"
+#include "VulkanCulling.h"
+#include "WorkerPool.h"
+#include "VulkanDeletionQueue.h"
+#include "VulkanPipelineRegistry.h"
+#include "VulkanDescriptors.h"
+#include "VulkanBindless.h"
+#include "VulkanRenderGraph.h"
+#include "VulkanGpuProfiler.h"
 
 
 #define GLM_FORCE_RADIANS
@@ -35,6 +45,7 @@ namespace VEngine {
 	const bool enableValidationLayers = false;
 #endif
 	extern VertexLayout vertexLayout;
+	extern const VertexLayout quantizedVertexLayout;
 
 	static std::vector<char> readFile(const std::string& filename) {
 		std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -104,6 +115,38 @@ namespace VEngine {
 		glm::mat4 proj;
 	};
 
+	//Per object data in the storage buffer, indexed by gl_InstanceIndex
+	struct ObjectData {
+		glm::mat4 model;
+		//x is the object's texture in the bindless array
+		glm::uvec4 material;
+	};
+
+	//Samples the bindless texture array, only used when the device has descriptor indexing
+	const static char* const BINDLESS_FRAGMENT_SHADER = "resources/shaders/frag_bindless.spv";
+	const static char* const QUANTIZED_VERTEX_SHADER = "resources/shaders/vert_quantized.spv";
+
+	const static uint32_t MAX_OBJECTS = 131072;
+	const static uint32_t MAX_INDIRECT_DRAWS = 4096;
+	const static uint32_t NO_DRAW_SLOT = UINT32_MAX;
+
+	//Draw recording is split over threads only when each would get at least this many draws
+	const static size_t MIN_DRAWS_PER_THREAD = 256;
+	const static uint32_t MAX_RECORD_THREADS = 8;
+
+	//Every model sharing a mesh and pipeline, drawn with one instanced call
+	struct InstanceBatch {
+		Model* model;
+		VkPipeline* pipeline;
+		std::vector<VulkanModelComponent*> instances;
+
+		//Indirect command this batch draws from this frame, or NO_DRAW_SLOT when it has nothing to draw
+		uint32_t drawSlot = NO_DRAW_SLOT;
+		//The command's instances, for drawing directly on devices without drawIndirectFirstInstance
+		uint32_t firstInstance = 0;
+		uint32_t instanceCount = 0;
+	};
+
 	//static std::vector<Vertex> vertices = {
 
 	//FRONT
@@ -174,7 +217,7 @@ namespace VEngine {
 	class VulkanRenderer
 	{
 	public:
-		VulkanRenderer() { framebufferResized = false; sceneChanged = false; };
+		VulkanRenderer() { framebufferResized = false; coherentUniforms = true; };
 
 		void createInstance();
 		void createSurface();
@@ -183,28 +226,53 @@ namespace VEngine {
 
 		void initVulkan(int width, int height);
 		void createGraphicsPipeline();
+		void destroyGraphicsPipeline();
 		void createRenderPass();
-		void createCommandBuffers();
+		void createCommandPools();
 		void createSyncObjects();
 		void createBuffers();
 		void createUniformBuffers();
+		void destroyUniformBuffers();
 		void createDescriptorSetLayout();
-		void createDescriptorPool();
+		void createDescriptorAllocators();
 		void createDescriptorSets();
+		void writeDescriptorSets();
+		void createCulling();
+		void createBindless();
 		void refresh();
 
-		void updateCommandBuffers();
+		void recordCommandBuffer(uint32_t frame, uint32_t imageIndex);
+		void recordMainPass(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t imageIndex);
+		void recordReadback(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t imageIndex);
+		//Waits on a frame in flight's fence, measuring the input latency of the frame it covers
+		void waitForFrame(uint32_t frame);
+		//Notes the time frames in flight are first seen finished, without waiting on them
+		void pollFrames();
+		void recordDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t first, size_t last);
+		void writeDraws(uint32_t frame, const glm::mat4& viewProj);
+		bool isUploaded(Model* model);
 
-		void createColorResources();
 		void createDepthResources();
+		void buildRenderGraph();
 
-		void updateFrame(uint32_t currentImage);
+		void updateCamera();
+		void updateFrame(uint32_t frame);
+		//Called at the top of the main loop before input is polled. In low latency mode it waits for the GPU to
+		//finish every frame in flight, which drawFrame would otherwise wait on after the simulation had run
+		void beginFrame();
 		void drawFrame();
 
 		VulkanDevice* getDevice() { return m_device; };
 
+		//Maps object transforms to clip space, for the frame updateCamera last set up
+		glm::mat4 getViewProjection() { return m_camera.proj * m_camera.view * m_camera.model; };
+		bool isGpuCulling() { return m_culling.isEnabled(); };
+		//The recording threads, free for other per frame work outside drawFrame
+		WorkerPool* getWorkerPool() { return &m_recordThreads; };
+
 		VkShaderModule createShaderModule(const std::vector<char>& code);
 
+		//Frees what's sized to the window at shutdown, refresh() retires it through the deletion queue instead
 		void cleanupSwapChain();
 		void cleanup();
 
@@ -217,10 +285,66 @@ namespace VEngine {
 		bool framebufferResized;
 		std::map<int, VulkanModelComponent*> m_models;
 
-		void pushBackModel(int id, VulkanModelComponent* model) { sceneChanged = true;  model->pipeline = &m_graphicsPipeline; m_models.insert(std::pair<int, VulkanModelComponent*>(id, model)); };
-		void removeModel(int id) { sceneChanged = true; m_models.erase(id); };
-
-		bool sceneChanged;
+		void pushBackModel(int id, VulkanModelComponent* model);
+		void removeModel(int id);
+
+		//Runs destroy once the frames that may still use a resource have finished, without waiting on the GPU
+		void deferDestroy(std::function<void()> destroy, uint64_t uploadSerial = 0);
+
+		//Destroys a model no entity uses anymore, once the frames that may still draw it have finished
+		void retireModel(Model* model);
+
+		//Description of the default pipeline, for building variants of it
+		PipelineDesc getDefaultPipelineDesc();
+		//Set as a model's pipeline before pushBackModel, it draws with the default pipeline until compiled
+		VkPipeline* requestPipeline(const PipelineDesc& desc);
+
+		DescriptorLayoutCache* getLayoutCache() { return m_device->getLayoutCache(); };
+		//Kept until cleanup
+		VkDescriptorSet allocateSet(VkDescriptorSetLayout layout);
+		//Only valid for the frame being recorded, its pool is reset once the frame's fence has passed
+		VkDescriptorSet allocateFrameSet(VkDescriptorSetLayout layout);
+
+		//GPU time per pass of the frame recorded getFramesInFlight() frames ago, read back once its fence had signalled
+		const std::vector<GpuScopeResult>& getGpuTimings() { return m_profiler.getResults(); };
+		uint32_t getFramesInFlight() { return m_framesInFlight; };
+
+		//Draws sample textures from one array by the index in their VulkanModelComponent
+		bool isBindless() { return m_bindlessEnabled; };
+		//Index for VulkanModelComponent::textureIndex, 0 without bindless where only the default texture is bound
+		uint32_t addTexture(Texture& texture);
+		void releaseTexture(uint32_t index);
+
+		//Set before initVulkan to keep uniforms in non-coherent memory, written with explicit flushes
+		bool coherentUniforms;
+
+		//Set before initVulkan to render into offscreen images, with no window, surface or presenting.
+		//readback copies every frame back to host memory as well, for readFrame() and saveFrame()
+		bool headless = false;
+		bool readback = false;
+
+		//When set the camera is posed at this many seconds in rather than by the clock, for repeatable frames
+		float cameraTime = -1.0f;
+
+		//Presentation, set before initVulkan. FIFO waits for vblank, mailbox replaces the queued image without waiting and
+		//immediate presents straight away, tearing. A swap image count of 0 takes one more than the surface's minimum
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+		uint32_t swapImageCount = 0;
+		//Frames the CPU may record ahead of the GPU, each with its own buffers, command pools and sync objects
+		uint32_t framesInFlight = 2;
+		//beginFrame waits for the GPU to finish the last frame before input is polled for the next, trading throughput
+		//for input to present latency
+		bool lowLatency = false;
+		//Set before initVulkan to load meshes with quantizedVertexLayout, 20 bytes a vertex instead of 44
+		bool quantizedVertices = false;
+
+		//Switches present mode while running, recreating the swapchain after the next present
+		void setPresentMode(VkPresentModeKHR mode);
+
+		//The last frame submitted as tightly packed RGBA8, waiting for it to finish first
+		bool readFrame(std::vector<uint8_t>& pixels);
+		bool saveFrame(const std::string& path);
+		VkExtent2D getExtent() { return m_swapChain->getSwapChainExtent(); };
 	private:
 		VulkanDevice* m_device;
 		VulkanSwapChain* m_swapChain;
@@ -230,13 +354,28 @@ namespace VEngine {
 		VkRenderPass m_renderPass;
 		VkDescriptorSetLayout m_descriptorSetLayout;
 		VkPipelineLayout m_pipelineLayout;
-		VkPipeline m_graphicsPipeline;
+		VulkanPipelineRegistry m_pipelines;
+		//Drawn with by models that didn't ask for a pipeline, and by the rest while theirs compile
+		VkPipeline* m_defaultPipeline = nullptr;
 
-		VkDescriptorPool m_descriptorPool;
+		DescriptorAllocator m_descriptors;
+		std::vector<DescriptorAllocator> m_frameDescriptors;
 		std::vector<VkDescriptorSet> m_descriptorSets;
 
+		//Instance made with VK_KHR_get_physical_device_properties2
+		bool m_physicalDeviceProperties2 = false;
+		VulkanBindless m_bindless;
+		bool m_bindlessEnabled = false;
 
-		std::vector<VkCommandBuffer> m_graphicsCommandBuffers;
+
+		//Command buffers are recorded fresh every frame from a pool owned by that frame in flight
+		std::vector<VkCommandPool> m_framePools;
+		std::vector<VkCommandBuffer> m_frameCommandBuffers;
+
+		//Secondary command buffers for the render pass, one per recording thread for each frame in flight
+		WorkerPool m_recordThreads;
+		std::vector<std::vector<VkCommandPool>> m_threadPools;
+		std::vector<std::vector<VkCommandBuffer>> m_secondaryBuffers;
 
 		std::vector<VkSemaphore> m_imageAvailableSemaphores;
 		std::vector<VkSemaphore> m_renderFinishedSemaphores;
@@ -245,15 +384,55 @@ namespace VEngine {
 	//	VulkanBuffer m_vertexBuffer;
 	//	VulkanBuffer m_indexBuffer;
 		VulkanBuffer m_stagingBuffer;
-		std::vector<VulkanBuffer> m_uniformBuffers;
+		VulkanPerFrameBuffer m_uniformBuffer;
+		VulkanPerFrameBuffer m_objectBuffer;
+		VulkanPerFrameBuffer m_indirectBuffer;
+		VulkanPerFrameBuffer m_visibleBuffer;
+		VulkanPerFrameBuffer m_readbackBuffer;
+		//Slot of the last frame submitted, -1 before the first
+		int64_t m_lastSubmittedFrame = -1;
+		//When input was polled ahead of each slot's last frame, cleared once the latency is measured
+		std::vector<std::chrono::steady_clock::time_point> m_inputTimes;
+		//When each slot's last frame was first seen finished, by pollFrames or waitForFrame
+		std::vector<std::chrono::steady_clock::time_point> m_doneTimes;
+		//Set by beginFrame once it has waited on every frame in flight, so drawFrame needn't
+		bool m_framesWaited = false;
+		uint32_t m_framesInFlight = 2;
+
+		VulkanCulling m_culling;
+
+		//Camera for the frame being built, written to the uniform buffer by updateFrame
+		UniformBufferObject m_camera = {};
 
 		Texture2D m_tex;
 		VkFormat m_depthFormat;
 
-		Texture2D m_colorTexture;
 		Texture2D m_depthTexture;
 
+		//Culling, the main pass and the depth pyramid, rebuilt along with the swapchain
+		VulkanRenderGraph m_graph;
+		VulkanGpuProfiler m_profiler;
+		RenderResource m_backbuffer = INVALID_RENDER_RESOURCE;
+		RenderResource m_colorTarget = INVALID_RENDER_RESOURCE;
+		//What the graph's passes record for, set by recordCommandBuffer
+		uint32_t m_recordFrame = 0;
+		uint32_t m_recordImageIndex = 0;
+
 		Model mdl;
 
+		//Draw calls and triangles written to the indirect buffer for the last frame
+		uint32_t m_recordedDrawCalls = 0;
+		uint64_t m_recordedTriangles = 0;
+
+		//Models grouped by mesh and pipeline, kept up to date as models come and go
+		std::vector<InstanceBatch> m_batches;
+		std::map<std::pair<Model*, VkPipeline*>, size_t> m_batchLookup;
+
+		//Batches given a draw slot this frame, in recording order
+		std::vector<size_t> m_drawnBatches;
+
+		//Frames started so far, deletions are tagged with it
+		uint64_t m_frameNumber = 0;
+		VulkanDeletionQueue m_deletionQueue;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "VulkanStagingBuffer.h"
+#include "VulkanDevice.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace VEngine {
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void VulkanStagingBuffer::create(VulkanDevice* device, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize size, VulkanStagingBuffer* acquirer)
+	{
+		m_device = device;
+		m_queue = queue;
+		m_queueFamilyIndex = queueFamilyIndex;
+
+		//Only needed when the data is read on another queue family
+		if (acquirer && acquirer->getQueueFamilyIndex() != queueFamilyIndex)
+			m_acquirer = acquirer;
+
+		m_capacity = size;
+		m_head = 0;
+		m_tail = 0;
+
+		m_commandPool = device->createCommandPool(queueFamilyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+		if (device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_buffer, size) != VK_SUCCESS) {
+			ELOG("Failed to create staging buffer!");
+			throw std::runtime_error("Failed to create staging buffer!");
+		}
+
+		if (m_buffer.map() != VK_SUCCESS) {
+			ELOG("Failed to map staging buffer!");
+			throw std::runtime_error("Failed to map staging buffer!");
+		}
+	}
+
+	void VulkanStagingBuffer::destroy()
+	{
+		flush();
+
+		for (auto& batch : m_freeBatches)
+		{
+			vkDestroyFence(m_device->getDevice(), batch.fence, nullptr);
+			vkDestroySemaphore(m_device->getDevice(), batch.semaphore, nullptr);
+		}
+		m_freeBatches.clear();
+
+		vkDestroyCommandPool(m_device->getDevice(), m_commandPool, nullptr);
+
+		m_buffer.unmap();
+		m_buffer.destroy();
+	}
+
+	VulkanStagingBuffer::Batch VulkanStagingBuffer::acquireBatch()
+	{
+		//Bound how far uploads can run ahead of the GPU
+		while (m_inFlight.size() >= STAGING_BATCH_COUNT)
+		{
+			waitOldest();
+		}
+
+		if (!m_freeBatches.empty())
+		{
+			Batch batch = std::move(m_freeBatches.back());
+			m_freeBatches.pop_back();
+			return batch;
+		}
+
+		Batch batch;
+		batch.commandBuffer = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false, 0, m_commandPool);
+
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		if (vkCreateFence(m_device->getDevice(), &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+			ELOG("Failed to create fence!");
+			throw std::runtime_error("Failed to create fence!");
+		}
+
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		if (vkCreateSemaphore(m_device->getDevice(), &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS) {
+			ELOG("Failed to create semaphore!");
+			throw std::runtime_error("Failed to create semaphore!");
+		}
+
+		return batch;
+	}
+
+	VkCommandBuffer VulkanStagingBuffer::getCommandBuffer()
+	{
+		if (!m_current.recording)
+		{
+			m_current = acquireBatch();
+			m_current.serial = m_nextSerial++;
+
+			VkCommandBufferBeginInfo beginInfo = {};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+			vkBeginCommandBuffer(m_current.commandBuffer, &beginInfo);
+			m_current.recording = true;
+		}
+
+		return m_current.commandBuffer;
+	}
+
+	bool VulkanStagingBuffer::reserve(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		bool empty = !m_current.usesRing && std::none_of(m_inFlight.begin(), m_inFlight.end(), [](const Batch& batch) { return batch.usesRing; });
+		if (empty)
+		{
+			m_head = 0;
+			m_tail = 0;
+		}
+
+		VkDeviceSize pos = alignUp(m_head, alignment);
+
+		if (empty || m_head >= m_tail)
+		{
+			//Free space is [head, capacity) followed by [0, tail)
+			if (pos + size > m_capacity)
+			{
+				if (size >= m_tail)
+					return false;
+
+				pos = 0;
+			}
+		}
+		else if (pos + size >= m_tail)
+		{
+			return false;
+		}
+
+		offset = pos;
+		m_head = pos + size;
+		return true;
+	}
+
+	StagingRegion VulkanStagingBuffer::stage(const void* data, VkDeviceSize size, VkDeviceSize alignment)
+	{
+		StagingRegion region;
+		region.size = size;
+
+		if (size > m_capacity / 2)
+		{
+			getCommandBuffer();
+
+			VulkanBuffer oversized;
+			if (m_device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &oversized, size, const_cast<void*>(data)) != VK_SUCCESS) {
+				ELOG("Failed to create staging buffer!");
+				throw std::runtime_error("Failed to create staging buffer!");
+			}
+
+			region.buffer = oversized.getBuffer();
+			region.offset = 0;
+			m_current.oversized.push_back(oversized);
+			return region;
+		}
+
+		m_device->recordUpload(size);
+
+		VkDeviceSize offset = 0;
+		if (!reserve(size, alignment, offset))
+		{
+			//Out of room, push what we have to the GPU and wait for the oldest batches to give space back
+			submit();
+			while (!reserve(size, alignment, offset))
+			{
+				if (m_inFlight.empty())
+				{
+					ELOG("Staging buffer is too small for upload!");
+					throw std::runtime_error("Staging buffer is too small for upload!");
+				}
+				waitOldest();
+			}
+		}
+
+		getCommandBuffer();
+		m_current.usesRing = true;
+		m_current.end = m_head;
+
+		memcpy(static_cast<char*>(m_buffer.getMapped()) + offset, data, (size_t)size);
+
+		region.buffer = m_buffer.getBuffer();
+		region.offset = offset;
+		return region;
+	}
+
+	void VulkanStagingBuffer::uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset)
+	{
+		StagingRegion region = stage(data, size);
+
+		VkBufferCopy copyRegion = {};
+		copyRegion.srcOffset = region.offset;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(getCommandBuffer(), region.buffer, dst, 1, &copyRegion);
+
+		if (m_acquirer)
+		{
+			VkBufferMemoryBarrier release = {};
+			release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			release.dstAccessMask = 0;
+			release.srcQueueFamilyIndex = m_queueFamilyIndex;
+			release.dstQueueFamilyIndex = m_acquirer->getQueueFamilyIndex();
+			release.buffer = dst;
+			release.offset = dstOffset;
+			release.size = size;
+			m_current.releases.push_back(release);
+		}
+	}
+
+	void VulkanStagingBuffer::acquire(const std::vector<VkBufferMemoryBarrier>& barriers, VkSemaphore semaphore)
+	{
+		//Acquires must match the releases exactly, only the access masks change sides
+		std::vector<VkBufferMemoryBarrier> acquires = barriers;
+		for (auto& barrier : acquires)
+		{
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		}
+
+		vkCmdPipelineBarrier(getCommandBuffer(),
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr,
+			static_cast<uint32_t>(acquires.size()), acquires.data(),
+			0, nullptr);
+
+		m_current.waitSemaphores.push_back(semaphore);
+	}
+
+	void VulkanStagingBuffer::submit()
+	{
+		if (!m_current.recording)
+			return;
+
+		if (m_acquirer)
+		{
+			//Hand the buffers over to the acquirer's family, a transfer only queue can't name the stages that will read them
+			if (!m_current.releases.empty())
+			{
+				vkCmdPipelineBarrier(m_current.commandBuffer,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+					0, nullptr,
+					static_cast<uint32_t>(m_current.releases.size()), m_current.releases.data(),
+					0, nullptr);
+			}
+		}
+		else
+		{
+			//Make every copy in the batch visible to whatever reads the data afterwards on this queue
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+			vkCmdPipelineBarrier(m_current.commandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+				1, &barrier,
+				0, nullptr,
+				0, nullptr);
+		}
+
+		if (vkEndCommandBuffer(m_current.commandBuffer) != VK_SUCCESS) {
+			ELOG("Failed to end command buffer!");
+			throw std::runtime_error("Failed to end command buffer!");
+		}
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &m_current.commandBuffer;
+
+		std::vector<VkPipelineStageFlags> waitStages(m_current.waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(m_current.waitSemaphores.size());
+		submitInfo.pWaitSemaphores = m_current.waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
+
+		bool release = m_acquirer && !m_current.releases.empty();
+		if (release)
+		{
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &m_current.semaphore;
+		}
+
+		vkResetFences(m_device->getDevice(), 1, &m_current.fence);
+
+		if (vkQueueSubmit(m_queue, 1, &submitInfo, m_current.fence) != VK_SUCCESS) {
+			ELOG("Failed to submit upload batch!");
+			throw std::runtime_error("Failed to submit upload batch!");
+		}
+
+		static Counter* batches = Metrics::get().counter("vengine_staging_batches_total", "Upload batches submitted from the staging ring");
+		batches->add();
+
+		std::vector<VkBufferMemoryBarrier> releases;
+		if (release)
+			releases.swap(m_current.releases);
+		VkSemaphore semaphore = m_current.semaphore;
+
+		m_lastSerial = m_current.serial;
+		m_current.recording = false;
+		m_inFlight.push_back(std::move(m_current));
+		m_current = Batch();
+
+		//Submitted right behind the release so the semaphore's wait is queued before it can be signalled again
+		if (release)
+		{
+			m_acquirer->acquire(releases, semaphore);
+			m_acquirer->submit();
+		}
+	}
+
+	void VulkanStagingBuffer::flush()
+	{
+		submit();
+		while (!m_inFlight.empty())
+		{
+			waitOldest();
+		}
+	}
+
+	void VulkanStagingBuffer::reclaim()
+	{
+		while (!m_inFlight.empty() && vkGetFenceStatus(m_device->getDevice(), m_inFlight.front().fence) == VK_SUCCESS)
+		{
+			retire(m_inFlight.front());
+			m_inFlight.pop_front();
+		}
+	}
+
+	void VulkanStagingBuffer::waitOldest()
+	{
+		Batch& oldest = m_inFlight.front();
+		vkWaitForFences(m_device->getDevice(), 1, &oldest.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		retire(oldest);
+		m_inFlight.pop_front();
+	}
+
+	void VulkanStagingBuffer::retire(Batch& batch)
+	{
+		for (auto& buffer : batch.oversized)
+		{
+			buffer.destroy();
+		}
+
+		//Batches retire in submission order, so everything before this batch's end is free again
+		if (batch.usesRing)
+		{
+			m_tail = batch.end;
+		}
+
+		m_completedSerial = batch.serial;
+
+		Batch recycled;
+		recycled.commandBuffer = batch.commandBuffer;
+		recycled.fence = batch.fence;
+		recycled.semaphore = batch.semaphore;
+		m_freeBatches.push_back(std::move(recycled));
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <vector>
+
+#include "VulkanBuffer.h"
+
+namespace VEngine {
+
+	class VulkanDevice;
+
+	const static VkDeviceSize DEFAULT_STAGING_BUFFER_SIZE = 32ull * 1024 * 1024;
+	const static uint32_t STAGING_BATCH_COUNT = 4;
+
+	struct StagingRegion
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+	};
+
+	/*
+	 * A persistently mapped, host visible ring buffer that all uploads are written into.
+	 * Copies are recorded into one command buffer per batch and go out together when submit() is called,
+	 * once per frame, ahead of the frame's own work. Each batch owns a fence, the ring space it used is
+	 * reclaimed once that fence signals.
+	 *
+	 * Always stage() before recording the commands that read from the region: staging may have to submit
+	 * the open batch to make room, which starts a new command buffer.
+	 *
+	 * A ring created with an acquirer on another queue family releases every buffer it uploads to that family.
+	 * The matching acquire barriers are handed to the acquirer along with a semaphore to wait on, and submitted
+	 * straight away so each semaphore signal is always paired with its wait.
+	 */
+	class VulkanStagingBuffer
+	{
+	public:
+		void create(VulkanDevice* device, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize size = DEFAULT_STAGING_BUFFER_SIZE, VulkanStagingBuffer* acquirer = nullptr);
+		void destroy();
+
+		StagingRegion stage(const void* data, VkDeviceSize size, VkDeviceSize alignment = 16);
+
+		void uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0);
+
+		//The command buffer of the open batch, begun on first use
+		VkCommandBuffer getCommandBuffer();
+
+		//Submits the open batch, if it has anything in it
+		void submit();
+
+		//Submits the open batch and waits for everything in flight to finish
+		void flush();
+
+		//Retires batches whose fences have signalled
+		void reclaim();
+
+		//Records acquire barriers for buffers released by another queue family, the open batch waits on semaphore before running
+		void acquire(const std::vector<VkBufferMemoryBarrier>& barriers, VkSemaphore semaphore);
+
+		//Serial of the batch the last upload went into, complete once that batch has retired
+		uint64_t getUploadSerial() const { return m_current.recording ? m_current.serial : m_lastSerial; };
+		bool isComplete(uint64_t serial) const { return serial <= m_completedSerial; };
+
+		bool hasPendingWork() const { return m_current.recording; };
+		uint32_t getQueueFamilyIndex() const { return m_queueFamilyIndex; };
+
+	private:
+		struct Batch
+		{
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			VkSemaphore semaphore = VK_NULL_HANDLE;
+			uint64_t serial = 0;
+			VkDeviceSize end = 0;
+			bool usesRing = false;
+			bool recording = false;
+
+			//Uploads too large for the ring get their own buffer, released with the batch
+			std::vector<VulkanBuffer> oversized;
+
+			//Ownership releases to the acquirer's family, and semaphores from other queues to wait on
+			std::vector<VkBufferMemoryBarrier> releases;
+			std::vector<VkSemaphore> waitSemaphores;
+		};
+
+		bool reserve(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		void retire(Batch& batch);
+		void waitOldest();
+		Batch acquireBatch();
+
+		VulkanDevice* m_device = nullptr;
+		VkQueue m_queue = VK_NULL_HANDLE;
+		uint32_t m_queueFamilyIndex = 0;
+		VkCommandPool m_commandPool = VK_NULL_HANDLE;
+		VulkanStagingBuffer* m_acquirer = nullptr;
+
+		VulkanBuffer m_buffer;
+		VkDeviceSize m_capacity = 0;
+		VkDeviceSize m_head = 0;
+		VkDeviceSize m_tail = 0;
+
+		uint64_t m_nextSerial = 1;
+		uint64_t m_lastSerial = 0;
+		uint64_t m_completedSerial = 0;
+
+		Batch m_current;
+		std::deque<Batch> m_inFlight;
+		std::vector<Batch> m_freeBatches;
+	};
+}
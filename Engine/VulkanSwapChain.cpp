@@ -5,7 +5,7 @@
 
 namespace VEngine {
 
-	void VulkanSwapChain::createSwapChain(VulkanDevice* device, VkSurfaceKHR surface, uint32_t width, uint32_t height)
+	void VulkanSwapChain::createSwapChain(VulkanDevice* device, VkSurfaceKHR surface, uint32_t width, uint32_t height, VkSwapchainKHR oldSwapChain)
 	{
 		m_device = device;
 		m_surface = surface;
@@ -15,10 +15,12 @@ namespace VEngine {
 		SwapChainSupportDetails swapChainSupport = device->querySwapChainSupport(device->getPhysicalDevice());
 
 		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-		VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+		VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes, m_requestedPresentMode);
 		VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
 		uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+		if (m_requestedImageCount > 0)
+			imageCount = std::max(m_requestedImageCount, swapChainSupport.capabilities.minImageCount);
 		if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
 			imageCount = swapChainSupport.capabilities.maxImageCount;
 		}
@@ -51,7 +53,7 @@ namespace VEngine {
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE;
 
-		createInfo.oldSwapchain = VK_NULL_HANDLE;
+		createInfo.oldSwapchain = oldSwapChain;
 
 		if (vkCreateSwapchainKHR(device->getDevice(), &createInfo, nullptr, &m_swapChain) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create swap chain!");
@@ -63,16 +65,42 @@ namespace VEngine {
 
 		m_swapChainImageFormat = surfaceFormat.format;
 		m_swapChainExtent = extent;
+		m_presentMode = presentMode;
 	}
 
-	void VulkanSwapChain::createFramebuffers(VkRenderPass renderPass, Texture2D depthTexture, Texture2D colorTexture)
+	std::function<void()> VulkanSwapChain::recreate(uint32_t width, uint32_t height)
+	{
+		std::vector<VkFramebuffer> oldFramebuffers = m_swapChainFramebuffers;
+		std::vector<VkImageView> oldImageViews = m_swapChainImageViews;
+		m_swapChainFramebuffers.clear();
+		m_swapChainImageViews.clear();
+
+		//Handing over the old swapchain lets the driver reuse its resources and keep presenting what it has queued
+		VkSwapchainKHR oldSwapChain = m_swapChain;
+		createSwapChain(m_device, m_surface, width, height, oldSwapChain);
+
+		createImageViews();
+
+		VkDevice device = m_device->getDevice();
+		return [device, oldSwapChain, oldFramebuffers, oldImageViews]() {
+			for (auto framebuffer : oldFramebuffers) {
+				vkDestroyFramebuffer(device, framebuffer, nullptr);
+			}
+			for (auto imageView : oldImageViews) {
+				vkDestroyImageView(device, imageView, nullptr);
+			}
+			vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+		};
+	}
+
+	void VulkanSwapChain::createFramebuffers(VkRenderPass renderPass, VkImageView depthView, VkImageView colorView)
 	{
 		m_swapChainFramebuffers.resize(m_swapChainImageViews.size());
 		for (size_t i = 0; i < m_swapChainImageViews.size(); i++) {
 
 			std::array<VkImageView, 3> attachments = {
-				colorTexture.getView(),
-				depthTexture.getView(),
+				colorView,
+				depthView,
 				m_swapChainImageViews[i]		
 			};	
 
@@ -119,22 +147,23 @@ namespace VEngine {
 		}
 	}
 
-	VkPresentModeKHR VulkanSwapChain::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, bool vsync) {
-		VkPresentModeKHR bestMode = VK_PRESENT_MODE_FIFO_KHR;
+	VkPresentModeKHR VulkanSwapChain::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, VkPresentModeKHR requested) {
+		auto available = [&](VkPresentModeKHR mode) {
+			return std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end();
+		};
 
-		if (!vsync)
-		{
-			for (const auto& availablePresentMode : availablePresentModes) {
-				if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-					return availablePresentMode;
-				}
-				else if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-					bestMode = availablePresentMode;
-				}
-			}
-		}
+		if (available(requested))
+			return requested;
 
-		return bestMode;
+		//Mailbox and immediate both stop the CPU waiting on vblank, the closest to one is the other
+		VkPresentModeKHR fallback = VK_PRESENT_MODE_FIFO_KHR;
+		if (requested == VK_PRESENT_MODE_MAILBOX_KHR && available(VK_PRESENT_MODE_IMMEDIATE_KHR))
+			fallback = VK_PRESENT_MODE_IMMEDIATE_KHR;
+		else if (requested == VK_PRESENT_MODE_IMMEDIATE_KHR && available(VK_PRESENT_MODE_MAILBOX_KHR))
+			fallback = VK_PRESENT_MODE_MAILBOX_KHR;
+
+		WLOG("Requested present mode isn't supported, falling back!");
+		return fallback;
 	}
 
 	VkSurfaceFormatKHR VulkanSwapChain::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
@@ -167,6 +196,55 @@ namespace VEngine {
 		}
 	}
 
+	void VulkanSwapChain::createOffscreen(VulkanDevice* device, uint32_t width, uint32_t height, uint32_t imageCount, VkFormat format)
+	{
+		m_device = device;
+		m_surface = VK_NULL_HANDLE;
+		m_swapChain = VK_NULL_HANDLE;
+		m_width = width;
+		m_height = height;
+
+		m_swapChainImageFormat = format;
+		m_swapChainExtent = { width, height };
+
+		m_swapChainImages.resize(imageCount);
+		m_offscreenAllocations.resize(imageCount);
+
+		for (uint32_t i = 0; i < imageCount; i++)
+		{
+			VkImageCreateInfo imageInfo = {};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.extent.width = width;
+			imageInfo.extent.height = height;
+			imageInfo.extent.depth = 1;
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.format = format;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			if (vkCreateImage(device->getDevice(), &imageInfo, nullptr, &m_swapChainImages[i]) != VK_SUCCESS) {
+				ELOG("Failed to create image!");
+				throw std::runtime_error("Failed to create image!");
+			}
+
+			VkMemoryRequirements memRequirements;
+			vkGetImageMemoryRequirements(device->getDevice(), m_swapChainImages[i], &memRequirements);
+
+			uint32_t memoryType = device->getMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			m_offscreenAllocations[i] = device->getAllocator()->allocate(memRequirements, memoryType, AllocationKind::Optimal);
+
+			if (vkBindImageMemory(device->getDevice(), m_swapChainImages[i], m_offscreenAllocations[i].memory, m_offscreenAllocations[i].offset) != VK_SUCCESS) {
+				ELOG("Failed to bind image memory!");
+				throw std::runtime_error("Failed to bind image memory!");
+			}
+		}
+	}
+
 	void VulkanSwapChain::destroy()
 	{
 		destroyFramebuffers();
@@ -174,6 +252,18 @@ namespace VEngine {
 		for (auto imageView : m_swapChainImageViews) {
 			vkDestroyImageView(m_device->getDevice(), imageView, nullptr);
 		}
+
+		if (isOffscreen())
+		{
+			for (size_t i = 0; i < m_swapChainImages.size(); i++)
+			{
+				vkDestroyImage(m_device->getDevice(), m_swapChainImages[i], nullptr);
+				m_device->getAllocator()->free(m_offscreenAllocations[i]);
+			}
+			m_offscreenAllocations.clear();
+			return;
+		}
+
 		vkDestroySwapchainKHR(m_device->getDevice(), m_swapChain, nullptr);
 		
 	}
@@ -183,6 +273,7 @@ namespace VEngine {
 		for (auto framebuffer : m_swapChainFramebuffers) {
 			vkDestroyFramebuffer(m_device->getDevice(), framebuffer, nullptr);
 		}
+		m_swapChainFramebuffers.clear();
 	}
 
 }
\ No newline at end of file
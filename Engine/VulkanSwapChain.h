@@ -3,21 +3,34 @@
 #include "VulkanDevice.h"
 #include "VulkanTexture.h"
 #include <array>
+#include <functional>
 
 namespace VEngine {
 
 	class VulkanSwapChain
 	{
 	public:
-		void createSwapChain(VulkanDevice* device, VkSurfaceKHR surface, uint32_t width, uint32_t height);
+		void createSwapChain(VulkanDevice* device, VkSurfaceKHR surface, uint32_t width, uint32_t height, VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+		//Replaces the swapchain for a new size, handing the old one over. Its image views are remade, framebuffers are left to the caller.
+		//The old swapchain, views and framebuffers may still be presenting, so they're handed back as a function freeing them later
+		std::function<void()> recreate(uint32_t width, uint32_t height);
+		//Plain images standing in for a swapchain when rendering headless, they're cycled through rather than acquired
+		void createOffscreen(VulkanDevice* device, uint32_t width, uint32_t height, uint32_t imageCount, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+		bool isOffscreen() { return m_surface == VK_NULL_HANDLE; };
 
-		VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, bool vsync = true);
+		//Taken up by the next createSwapChain() or recreate(). An image count of 0 asks for one more than the surface's minimum
+		void setPresentMode(VkPresentModeKHR mode) { m_requestedPresentMode = mode; };
+		void setImageCount(uint32_t count) { m_requestedImageCount = count; };
+		VkPresentModeKHR getPresentMode() { return m_presentMode; };
+
+		//The requested mode if the surface has it, otherwise the other mode that doesn't wait for vblank, then FIFO, which every surface has
+		VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, VkPresentModeKHR requested);
 		VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
 		VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 
 		void createImageViews();
-		void createFramebuffers(VkRenderPass renderPass, Texture2D depthTexture, Texture2D colorTexture);
+		void createFramebuffers(VkRenderPass renderPass, VkImageView depthView, VkImageView colorView);
 
 		void destroy();
 		void destroyFramebuffers();
@@ -36,7 +49,7 @@ namespace VEngine {
 		int getHeight() { return m_height; };
 	private:
 		VulkanDevice* m_device;
-		VkSurfaceKHR m_surface;
+		VkSurfaceKHR m_surface = VK_NULL_HANDLE;
 
 		std::vector<VkImageView> m_swapChainImageViews;
 
@@ -45,6 +58,11 @@ namespace VEngine {
 		VkFormat m_swapChainImageFormat;
 		VkExtent2D m_swapChainExtent;
 		std::vector<VkFramebuffer> m_swapChainFramebuffers;
+		std::vector<VulkanAllocation> m_offscreenAllocations;
+
+		VkPresentModeKHR m_requestedPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+		VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+		uint32_t m_requestedImageCount = 0;
 
 
 		int m_width = 1920;
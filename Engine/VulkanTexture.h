@@ -24,9 +24,8 @@ namespace VEngine {
 		uint32_t m_layerCount;
 		VkImage m_image;
 		VkImageLayout m_imageLayout;
-		VkDeviceMemory m_deviceMemory;
+		VulkanAllocation m_allocation;
 		VkImageView m_view;
-		VulkanBuffer m_stagingBuffer;
 
 		void updateDescriptor()
 		{
@@ -49,7 +48,7 @@ namespace VEngine {
 			{
 				vkDestroySampler(m_device->getDevice(), m_sampler, nullptr);
 			}
-			vkFreeMemory(m_device->getDevice(), m_deviceMemory, nullptr);
+			m_device->getAllocator()->free(m_allocation);
 		}
 
 		void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties) {
@@ -77,17 +76,13 @@ namespace VEngine {
 			VkMemoryRequirements memRequirements;
 			vkGetImageMemoryRequirements(m_device->getDevice(), m_image, &memRequirements);
 
-			VkMemoryAllocateInfo allocInfo = {};
-			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			allocInfo.allocationSize = memRequirements.size;
-			allocInfo.memoryTypeIndex = m_device->getMemoryType(memRequirements.memoryTypeBits, properties);
+			uint32_t memoryType = m_device->getMemoryType(memRequirements.memoryTypeBits, properties);
+			m_allocation = m_device->getAllocator()->allocate(memRequirements, memoryType, tiling == VK_IMAGE_TILING_OPTIMAL ? AllocationKind::Optimal : AllocationKind::Linear);
 
-			if (vkAllocateMemory(m_device->getDevice(), &allocInfo, nullptr, &m_deviceMemory) != VK_SUCCESS) {
-				ELOG("Failed to allocate image memory!");
-				throw std::runtime_error("Failed to allocate image memory!");
+			if (vkBindImageMemory(m_device->getDevice(), m_image, m_allocation.memory, m_allocation.offset) != VK_SUCCESS) {
+				ELOG("Failed to bind image memory!");
+				throw std::runtime_error("Failed to bind image memory!");
 			}
-
-			vkBindImageMemory(m_device->getDevice(), m_image, m_deviceMemory, 0);
 		}
 
 		VkImageView createImageView(VkImage image, VkFormat format, uint32_t mipLevels = 1, VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT) {
@@ -111,8 +106,11 @@ namespace VEngine {
 			return imageView;
 		}
 
-		void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) {
-			VkCommandBuffer commandBuffer = m_device->beginSingleTimeCommands();
+		//Each of these records into commandBuffer when one is given, otherwise it submits and waits on its own
+		void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, VkCommandBuffer commandBuffer = VK_NULL_HANDLE) {
+			bool singleTime = commandBuffer == VK_NULL_HANDLE;
+			if (singleTime)
+				commandBuffer = m_device->beginSingleTimeCommands();
 
 			VkImageMemoryBarrier barrier = {};
 			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -182,14 +180,17 @@ namespace VEngine {
 				1, &barrier
 			);
 
-			m_device->endSingleTimeCommands(commandBuffer);
+			if (singleTime)
+				m_device->endSingleTimeCommands(commandBuffer);
 		}
 
-		void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-			VkCommandBuffer commandBuffer = m_device->beginSingleTimeCommands(m_device->getTransferCommandPool());
+		void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, VkDeviceSize bufferOffset = 0, VkCommandBuffer commandBuffer = VK_NULL_HANDLE) {
+			bool singleTime = commandBuffer == VK_NULL_HANDLE;
+			if (singleTime)
+				commandBuffer = m_device->beginSingleTimeCommands(m_device->getTransferCommandPool());
 
 			VkBufferImageCopy region = {};
-			region.bufferOffset = 0;
+			region.bufferOffset = bufferOffset;
 			region.bufferRowLength = 0;
 			region.bufferImageHeight = 0;
 			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -205,10 +206,11 @@ namespace VEngine {
 
 			vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-			m_device->endSingleTimeCommands(commandBuffer, m_device->getTransferCommandPool(), m_device->getTransferQueue());
+			if (singleTime)
+				m_device->endSingleTimeCommands(commandBuffer, m_device->getTransferCommandPool(), m_device->getTransferQueue());
 		}
 
-		void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
+		void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, VkCommandBuffer commandBuffer = VK_NULL_HANDLE)
 		{
 			VkFormatProperties formatProperties;
 			vkGetPhysicalDeviceFormatProperties(m_device->getPhysicalDevice(), imageFormat, &formatProperties);
@@ -218,7 +220,9 @@ namespace VEngine {
 				throw std::runtime_error("Texture image format does not support linear blitting!");
 			}
 
-			VkCommandBuffer commandBuffer = m_device->beginSingleTimeCommands();
+			bool singleTime = commandBuffer == VK_NULL_HANDLE;
+			if (singleTime)
+				commandBuffer = m_device->beginSingleTimeCommands();
 
 			VkImageMemoryBarrier barrier = {};
 			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -293,7 +297,8 @@ namespace VEngine {
 				0, nullptr,
 				1, &barrier);
 
-			m_device->endSingleTimeCommands(commandBuffer);
+			if (singleTime)
+				m_device->endSingleTimeCommands(commandBuffer);
 		}
 
 		
@@ -309,7 +314,7 @@ namespace VEngine {
 	class Texture2D : public Texture {
 	public:
 
-		void createTexture(std::string file) {
+		StagingRegion createTexture(std::string file) {
 			int texWidth, texHeight, texChannels;
 			stbi_uc* pixels = stbi_load(file.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 			VkDeviceSize imageSize = (uint64_t)texWidth * (uint64_t)texHeight * 4;
@@ -319,20 +324,20 @@ namespace VEngine {
 				throw std::runtime_error("Failed to load texture image!");
 			}
 
-			m_device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_stagingBuffer, static_cast<size_t>(imageSize), (void*)pixels);
+			StagingRegion region = m_device->getStagingBuffer()->stage(pixels, imageSize);
 			
 			stbi_image_free(pixels);
 
 			m_width = static_cast<uint32_t>(texWidth);
 			m_height = static_cast<uint32_t>(texHeight);
 
+			return region;
 		}
 
 		void loadFromFile(
 			std::string filename,
 			VkFormat format,
 			VulkanDevice* device,
-			VkQueue copyQueue,
 			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
 			VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			bool generateMipMaps = true,
@@ -340,7 +345,7 @@ namespace VEngine {
 		{
 			m_device = device;
 
-			createTexture(filename);
+			StagingRegion staging = createTexture(filename);
 
 			if (generateMipMaps) {
 				m_mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(m_width, m_height)))) + 1;
@@ -352,15 +357,16 @@ namespace VEngine {
 
 			createImage(m_width, m_height, m_mipLevels, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-			transitionImageLayout(m_image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_mipLevels);
+			//Record the upload into the staging ring's open batch, it goes out with the next frame
+			VkCommandBuffer uploadCmd = m_device->getStagingBuffer()->getCommandBuffer();
 
-			copyBufferToImage(m_stagingBuffer.getBuffer(), m_image, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height));
+			transitionImageLayout(m_image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_mipLevels, uploadCmd);
 
-			generateMipmaps(m_image, VK_FORMAT_R8G8B8A8_UNORM, m_width, m_height, m_mipLevels);
+			copyBufferToImage(staging.buffer, m_image, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), staging.offset, uploadCmd);
 
-			//transitionImageLayout(m_image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_mipLevels);
+			generateMipmaps(m_image, VK_FORMAT_R8G8B8A8_UNORM, m_width, m_height, m_mipLevels, uploadCmd);
 
-			m_stagingBuffer.destroy();
+			//transitionImageLayout(m_image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_mipLevels);
 
 			m_view = createImageView(m_image, VK_FORMAT_R8G8B8A8_UNORM, m_mipLevels);;
 
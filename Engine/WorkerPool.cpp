@@ -0,0 +1,93 @@
+#include "WorkerPool.h"
+
+namespace VEngine {
+
+	void WorkerPool::start(uint32_t workerCount)
+	{
+		m_stopping = false;
+
+		for (uint32_t i = 0; i < workerCount; i++)
+		{
+			m_workers.emplace_back(&WorkerPool::workerLoop, this);
+		}
+	}
+
+	void WorkerPool::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_wake.notify_all();
+
+		for (std::thread& worker : m_workers)
+		{
+			worker.join();
+		}
+		m_workers.clear();
+	}
+
+	void WorkerPool::run(uint32_t jobCount, const std::function<void(uint32_t)>& job)
+	{
+		if (m_workers.empty() || jobCount <= 1)
+		{
+			for (uint32_t i = 0; i < jobCount; i++)
+			{
+				job(i);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_job = &job;
+			m_jobCount = jobCount;
+			m_nextJob = 0;
+			m_busyWorkers = m_workers.size();
+			m_generation++;
+		}
+		m_wake.notify_all();
+
+		takeJobs();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this]() { return m_busyWorkers == 0; });
+		m_job = nullptr;
+	}
+
+	void WorkerPool::takeJobs()
+	{
+		for (;;)
+		{
+			uint32_t index = m_nextJob.fetch_add(1);
+			if (index >= m_jobCount)
+				return;
+
+			(*m_job)(index);
+		}
+	}
+
+	void WorkerPool::workerLoop()
+	{
+		uint64_t seen = 0;
+
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [&]() { return m_stopping || m_generation != seen; });
+				if (m_stopping)
+					return;
+				seen = m_generation;
+			}
+
+			takeJobs();
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (--m_busyWorkers == 0)
+					m_done.notify_one();
+			}
+		}
+	}
+}
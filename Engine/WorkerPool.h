@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace VEngine {
+
+	/*
+	 * A few long lived threads for splitting per frame work, so a frame doesn't pay for starting threads.
+	 * run() hands out job indices to the workers and the calling thread alike, and returns once every job is done.
+	 */
+	class WorkerPool
+	{
+	public:
+		~WorkerPool() { stop(); };
+
+		void start(uint32_t workerCount);
+		void stop();
+
+		//Threads a run() can spread over, the caller included
+		uint32_t getThreadCount() { return static_cast<uint32_t>(m_workers.size()) + 1; };
+
+		void run(uint32_t jobCount, const std::function<void(uint32_t)>& job);
+
+	private:
+		void workerLoop();
+		void takeJobs();
+
+		std::vector<std::thread> m_workers;
+
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+
+		const std::function<void(uint32_t)>* m_job = nullptr;
+		uint32_t m_jobCount = 0;
+		std::atomic<uint32_t> m_nextJob{ 0 };
+
+		//Bumped for every run so sleeping workers can tell new work from a spurious wake
+		uint64_t m_generation = 0;
+		size_t m_busyWorkers = 0;
+		bool m_stopping = false;
+	};
+}
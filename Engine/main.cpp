@@ -1,10 +1,35 @@
 #include <iostream>
+#include <string>
 #include "Core.h"
-int main()
+#include "CullingBenchmark.h"
+#include "HeadlessRender.h"
+#include "RenderBenchmark.h"
+int main(int argc, char** argv)
 {
+	if (argc > 1 && std::string(argv[1]) == "--bench-culling")
+	{
+		size_t count = argc > 2 ? std::stoul(argv[2]) : 1000000;
+		return VEngine::runCullingBenchmark(count);
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--headless")
+	{
+		uint32_t frames = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 3;
+		std::string output = argc > 3 ? argv[3] : "";
+		return VEngine::runHeadlessRender(frames, output);
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--bench-render")
+	{
+		std::string scenario = argc > 2 ? argv[2] : "small";
+		uint32_t frames = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : 300;
+		std::string output = argc > 4 ? argv[4] : "";
+		return VEngine::runRenderBenchmark(scenario, frames, output);
+	}
+
 	VEngine::Engine* engine = new VEngine::Engine();
 
 	engine->init();
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -1,3 +1,9 @@
 C:/VulkanSDK/1.1.108.0/Bin32/glslangValidator.exe -V shader.vert
+C:/VulkanSDK/1.1.108.0/Bin32/glslangValidator.exe -V -DQUANTIZED shader.vert -o vert_quantized.spv
 C:/VulkanSDK/1.1.108.0/Bin32/glslangValidator.exe -V shader.frag
+C:/VulkanSDK/1.1.108.0/Bin32/glslangValidator.exe -V shader_bindless.frag -o frag_bindless.spv
+C:/VulkanSDK/1.1.108.0/Bin32/glslangValidator.exe -V cull.comp -o cull.spv
+C:/VulkanSDK/1.1.108.0/Bin32/glslangValidator.exe -V hiz_depth.comp -o hiz_depth.spv
+C:/VulkanSDK/1.1.108.0/Bin32/glslangValidator.exe -V -DMULTISAMPLED hiz_depth.comp -o hiz_depth_ms.spv
+C:/VulkanSDK/1.1.108.0/Bin32/glslangValidator.exe -V hiz_reduce.comp -o hiz_reduce.spv
 pause
\ No newline at end of file
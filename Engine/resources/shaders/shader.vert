@@ -7,18 +7,55 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
+struct ObjectData {
+    mat4 model;
+    //x is the texture in the bindless array
+    uvec4 material;
+};
+
+layout(std140, binding = 2) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+} objectBuffer;
+
+//Object index for every instance, compacted by the cull pass or the identity when culling is off
+layout(std430, binding = 3) readonly buffer VisibleBuffer {
+    uint indices[];
+} visible;
+
+//Compiled with QUANTIZED for quantizedVertexLayout, positions come in normalized and the object transform dequantizes them
 layout(location = 0) in vec3 inPosition;
+#ifdef QUANTIZED
+layout(location = 1) in vec2 inNormal;
+#else
 layout(location = 1) in vec3 inNormal;
+#endif
 layout(location = 2) in vec3 inColor;
 layout(location = 3) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragNormal;
+layout(location = 3) flat out uint fragTextureIndex;
+
+#ifdef QUANTIZED
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#endif
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    ObjectData object = objectBuffer.objects[visible.indices[gl_InstanceIndex]];
+    gl_Position = ubo.proj * ubo.view * ubo.model * object.model * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+#ifdef QUANTIZED
+    fragNormal = decodeOctahedral(inNormal);
+#else
     fragNormal = inNormal;
+#endif
+    fragTextureIndex = object.material.x;
 }
\ No newline at end of file